@@ -20,27 +20,132 @@ Copyright (C) 2017 	Martin Blom
  	date:		September 20, 2017												   	
 *************************************************************************************/
 #include "graph.h"
+#ifdef HAVE_ZLIB							// codecs stay out of the API header
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
 #define KILO 1000
 #define MEGA 1000000
+#define CHUNK 1048576						// # of values per chunk of spilled data
+#define IDXBASE 3							// smallest index block is 2^IDXBASE values
+#define IDXVERSION 1						// version of the index file format
+#define COLMAX 256							// # of fields of a row that can be selected
+#define ARENAMIN 65536						// smallest block of an arena (bytes)
+#define ARENABLOCKS 48						// # of blocks an arena can outgrow in one render
+#define SLICEMIN 1048576					// # of values a compress thread gets at least
+#define SLICEMAX 64							// # of threads compressing at most
 static const char LEGAL[] = "0123456789.-";	// legal characters in a float
-static int SCREEN_HEIGHT = 17;				// screen height
-static int SCREEN_WIDTH = 68;				// screen width
-static float maxval=FLT_MIN;				// maximum value, used for y-scaling
-static float minval=FLT_MAX;				// minimum value, used for y-scaling
-static char stylechar = '*';				// default data point character
-static int compression = 2;					// compression scheme, 1=average 2=select
-static float USED = -M_PI;
+static const char* FORMATS[] = {"", "f32", "f64", "i32", "i64"};	// binary input formats
+static const int FORMAT_SIZE[] = {0, 4, 8, 4, 8};	// bytes of a value of each format
+/************************************************************************************/
+/* graph context: all state of a graph, so that several graphs can be drawn at		*/
+/* once on different threads. The set_*() functions use a default context			*/
+/************************************************************************************/
+typedef struct								// aggregate of a slice of values
+{
+	float sum, min, max;
+} span;
+typedef struct								// text of a graph being drawn
+{
+	char* data;
+	size_t len;								// # of bytes drawn
+	size_t cap;								// size of data
+} frame;
+typedef struct								// an index mapped into memory
+{
+	char* map;
+	size_t len;
+	float* values;							// the values, right after the header
+	span* level[32];						// level[l] aggregates blocks of 2^(IDXBASE+l)
+	int levels;
+} pyramid;
+typedef struct								// scratch memory of a render, reused by the next
+{
+	char* block;							// the block handed out from
+	size_t cap;								// size of the block
+	size_t used;							// bytes of the block handed out
+	size_t total;							// bytes handed out since the last reset
+	void* outgrown[ARENABLOCKS];			// blocks too small for this render
+	int noutgrown;
+} arena;
+typedef struct								// stage timers and counters, see --stats
+{
+	double load, compress, render;			// seconds spent in each stage
+	long long bytes;						// bytes of input scanned
+	long long values;						// # of values loaded
+	long long skipped;						// # of non-floats skipped
+	long long output;						// bytes of graph drawn
+} counters;
+struct graph_ctx
+{
+	int height;								// screen height
+	int width;								// screen width
+	float maxval;							// maximum value, used for y-scaling
+	float minval;							// minimum value, used for y-scaling
+	char styles[SERIESMAX+1];				// data point character of each series
+	char unistyle[5];						// UTF-8 data point of the first series, if set
+	int cells;								// sub-rows per cell, 4 braille 2 quadrant 0 off
+	int compression;						// compression scheme, 1=average 2=select 3=min/max
+											// 4=quantiles
+	float quantiles[3];						// p50, p95 and p99 of the last series compressed
+	int window;								// # of values kept when streaming, 0=width
+	int refresh;							// redraw interval when streaming (ms)
+	int threads;							// # of threads parsing input
+	int index;								// 1 to keep a .graphidx index of input files
+	double from, to;						// time window, negative is before the last row
+	int columns[SERIESMAX];					// fields of a row drawn as series, from 0
+	int ncolumns;							// # of columns, 0 to read all values as one
+	frame screen;							// frame being drawn
+	frame shown;							// frame on the terminal, when redrawing
+	frame delta;							// changes from shown to screen
+	float shown_max, shown_min;				// y-scale of the frame on the terminal
+	float* values[SERIESMAX];				// values of each series loaded into memory
+	int values_cap[SERIESMAX];				// capacity of values, kept for the next load
+	float* spill_map[SERIESMAX];			// values of each series mapped from spill files
+	size_t spill_len[SERIESMAX];			// size of the mappings in bytes
+	pyramid index_map;						// index of the loaded values
+	double* times;							// time stamps of the loaded values
+	int format;								// binary input, index in FORMATS, 0 for text
+	int stride;								// bytes per record of binary input, 0=packed
+	int offset;								// byte of the value in a record
+	counters stats;							// what loading and drawing took so far
+	arena scratch;							// columns and plot rows of the current render
+	int histogram;							// 1 to draw the distribution of the values
+};
+#define CTX_DEFAULTS {17, 68, -FLT_MAX, FLT_MAX, "*o+x#@%&", "", 0, 2, {0}, 0, 500, 1, 0, -INFINITY, INFINITY}
+static graph_ctx deflt = CTX_DEFAULTS;		// context of the set_*() functions
 /************************************************************************************/
 /* status and error messages														*/
 /************************************************************************************/
 void usage()
 {
-	printf("usage:\tgraph [-sstyle] [-xsize] [-ysize] [-cC] [-l] [file]\n");
+	printf("usage:\tgraph [-sstyle] [-xsize] [-ysize] [-cC] [-l] [-f] [-wN] [-rN] [-tN] [-i] [file]\n");
 	printf("\tstyle - (a)sterisk (d)dash (p)eriod]\n");
 	printf("\t0 < xsize < %d, 0 < ysize < %d\n", WMAX, HMAX);
-	printf("\t-cC compression scheme, a for average, s for selection\n");
+	printf("\t-cC compression scheme, a for average, s for selection, m for min/max,\n");
+	printf("\t    q for p50/p95/p99 bands\n");
 	printf("\t-l prints license\n");
-	printf("\tfile should contain float values in plain text\n");
+	printf("\t-f follows file as it grows, -wN graphs the last N values\n");
+	printf("\t-rN redraws every N ms when following or reading stdin\n");
+	printf("\t-tN parses input on N threads, 0 for one per core\n");
+	printf("\t-i keeps an index, file.graphidx, to graph file again quickly\n");
+	printf("\t-kN,M,.. graphs columns N, M, .. of each row, styled by -sXY..\n");
+	printf("\t-sHEX plots with unicode character HEX, e.g. -s2588\n");
+	printf("\t-uC sub-cell points, b for braille (2x4 per cell), q for quadrants (2x2)\n");
+	printf("\t-W watches file, redrawing only what changed when it is rewritten\n");
+	printf("\t-T graphs rows of epoch,value over time (UTC), --from=T --to=T set the\n");
+	printf("\t   window, a negative T counts back from the last row\n");
+	printf("\t-H draws a histogram, ysize+1 bins from the smallest to the largest value\n");
+	printf("\t--format=F reads raw little-endian values, F is f32, f64, i32 or i64\n");
+	printf("\t   --stride=N --offset=M take the value at byte M of N byte records\n");
+	printf("\tfile should contain float values in plain text, - reads stdin\n");
+	printf("\t   as it arrives on a terminal, the last -wN values (xsize by default),\n");
+	printf("\t   otherwise whole\n");
+	printf("\t--stats writes time spent loading, compressing and drawing to stderr\n");
+	printf("\tseveral files, a quoted glob or @list (one file per line) are graphed in\n");
+	printf("\t   order by a pool of -tN threads, one per core by default\n");
 }
 static void print_data(float* buf, int size)
 {
@@ -49,6 +154,15 @@ static void print_data(float* buf, int size)
 		printf("buf[%d]=%1.5f, ", i,buf[i]);
 	printf("\n");
 }
+/************************************************************************************/
+/* seconds:		returns a monotonic time in seconds, for the stage timers			*/
+/************************************************************************************/
+static double seconds()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec+ts.tv_nsec*1e-9;
+}
 void error()
 {
 	usage();
@@ -56,7 +170,12 @@ void error()
 }
 void merror(char* filename, int buf_size)
 {
-	printf("%s is too large, %d floats. Max size is %d\n", filename, buf_size, MEMMAX);
+	printf("%s is too large, %d floats cannot be stored on disk\n", filename, buf_size);
+	exit(-1);
+}
+void aerror()
+{
+	printf("Memory error, buffer==NULL\n");
 	exit(-1);
 }
 void serror(char* msg, int size)
@@ -77,325 +196,2856 @@ void cerror()
 	printf("Compression scheme unknown, using selection as default\n");
 }
 /************************************************************************************/
-/* load_csv: 	loads values from input file to buffer								*/
-/* parameter: 	infil - file pointer to file										*/
-/* parameter: 	filename - file name												*/
+/* reduction kernels: sum, minimum and maximum of a slice of values in one sweep.	*/
+/* Every kernel adds in the same order, eight interleaved partial sums that are		*/
+/* combined pairwise, so the results are bit-identical whichever kernel runs		*/
+/************************************************************************************/
+#define MIN2(v, m) ((v)<(m)?(v):(m))		// same operand order as minps/maxps
+#define MAX2(v, m) ((v)>(m)?(v):(m))
+static void (*reduce)(const float* p, int n, span* out) = NULL;
 /************************************************************************************/
-static void load_csv(float* out_buf, FILE* infil, char* filename)
+/* reduce_finish:	combines the eight lanes pairwise and adds the remaining values	*/
+/* parameter: 		p, n - the slice, i - first value not in the lanes				*/
+/* parameter: 		s, lo, hi - per lane sums, minimums and maximums				*/
+/* parameter: 		out - the aggregate of the slice								*/
+/************************************************************************************/
+static void reduce_finish(const float* p, int i, int n, float* s, float* lo, float* hi, span* out)
 {
-	int i=0, count=0, islegal=0;
-	char ctmp, buf[FBUFMAX];
-	if(DEBUG)printf("loading data...");
-	rewind(infil);
-	while((ctmp=getc(infil))!=EOF)
-	{
-		if(strchr(LEGAL, ctmp))
+	int j, w;
+	for(w=4;w>0;w/=2)
+		for(j=0;j<w;j++)
 		{
-			if(i>=FBUFMAX){i=0;islegal=0;}
-			else
-			{
-				buf[i++] = ctmp;
-				if(DEBUG)printf("[%c]", ctmp);
-				islegal=1;
-			}
+			s[j] = s[j]+s[j+w];
+			lo[j] = MIN2(lo[j+w], lo[j]);
+			hi[j] = MAX2(hi[j+w], hi[j]);
 		}
-		else
+	out->sum = s[0];
+	out->min = lo[0];
+	out->max = hi[0];
+	for(;i<n;i++)
+	{
+		out->sum = out->sum+p[i];
+		out->min = MIN2(p[i], out->min);
+		out->max = MAX2(p[i], out->max);
+	}
+}
+/************************************************************************************/
+/* reduce_scalar:	portable kernel, also the reference for the SIMD kernels		*/
+/************************************************************************************/
+static void reduce_scalar(const float* p, int n, span* out)
+{
+	float s[8], lo[8], hi[8];
+	int i, j;
+	for(j=0;j<8;j++){s[j] = 0; lo[j] = INFINITY; hi[j] = -INFINITY;}
+	for(i=0;i+8<=n;i+=8)
+		for(j=0;j<8;j++)
 		{
-			if(islegal)
-			{
-				buf[i]='\0';
-				out_buf[count++] = atof(buf);
-				if(DEBUG) printf("out_buf[%d]=%f, ", count-1, out_buf[count-1]);
-				islegal=0;
-			}
-			i=0;
+			s[j] = s[j]+p[i+j];
+			lo[j] = MIN2(p[i+j], lo[j]);
+			hi[j] = MAX2(p[i+j], hi[j]);
 		}
+	reduce_finish(p, i, n, s, lo, hi, out);
+}
+#if defined(__x86_64__) || defined(__i386__)
+/************************************************************************************/
+/* reduce_sse2:	lanes 0-3 and 4-7 in two registers									*/
+/************************************************************************************/
+__attribute__((target("sse2")))
+static void reduce_sse2(const float* p, int n, span* out)
+{
+	__m128 s0=_mm_setzero_ps(), s1=_mm_setzero_ps(), v0, v1;
+	__m128 lo0=_mm_set1_ps(INFINITY), lo1=lo0, hi0=_mm_set1_ps(-INFINITY), hi1=hi0;
+	float s[8], lo[8], hi[8];
+	int i;
+	for(i=0;i+8<=n;i+=8)
+	{
+		v0 = _mm_loadu_ps(p+i);
+		v1 = _mm_loadu_ps(p+i+4);
+		s0 = _mm_add_ps(s0, v0);
+		s1 = _mm_add_ps(s1, v1);
+		lo0 = _mm_min_ps(v0, lo0);
+		lo1 = _mm_min_ps(v1, lo1);
+		hi0 = _mm_max_ps(v0, hi0);
+		hi1 = _mm_max_ps(v1, hi1);
+	}
+	_mm_storeu_ps(s, s0); _mm_storeu_ps(s+4, s1);
+	_mm_storeu_ps(lo, lo0); _mm_storeu_ps(lo+4, lo1);
+	_mm_storeu_ps(hi, hi0); _mm_storeu_ps(hi+4, hi1);
+	reduce_finish(p, i, n, s, lo, hi, out);
+}
+/************************************************************************************/
+/* reduce_avx2:	all eight lanes in one register										*/
+/************************************************************************************/
+__attribute__((target("avx2")))
+static void reduce_avx2(const float* p, int n, span* out)
+{
+	__m256 sv=_mm256_setzero_ps(), lov=_mm256_set1_ps(INFINITY), hiv=_mm256_set1_ps(-INFINITY), v;
+	float s[8], lo[8], hi[8];
+	int i;
+	for(i=0;i+8<=n;i+=8)
+	{
+		v = _mm256_loadu_ps(p+i);
+		sv = _mm256_add_ps(sv, v);
+		lov = _mm256_min_ps(v, lov);
+		hiv = _mm256_max_ps(v, hiv);
+	}
+	_mm256_storeu_ps(s, sv);
+	_mm256_storeu_ps(lo, lov);
+	_mm256_storeu_ps(hi, hiv);
+	reduce_finish(p, i, n, s, lo, hi, out);
+}
+#endif
+/************************************************************************************/
+/* pick_kernel:	selects the best kernel the CPU supports. GRAPH_KERNEL can be set	*/
+/*				to scalar, sse2 or avx2 to limit the choice. Runs once, see setup	*/
+/************************************************************************************/
+static void pick_kernel()
+{
+	char* limit = getenv("GRAPH_KERNEL");
+	reduce = reduce_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if(limit && !strcmp(limit, "scalar")) return;
+	if(__builtin_cpu_supports("sse2")) reduce = reduce_sse2;
+	if(limit && !strcmp(limit, "sse2")) return;
+	if(__builtin_cpu_supports("avx2")) reduce = reduce_avx2;
+#endif
+	if(DEBUG)printf("kernel: %s\n", reduce==reduce_scalar?"scalar":limit?limit:"best");
+}
+/************************************************************************************/
+/* quantile sketch: a KLL sketch, levels of sampled values where a value on level	*/
+/* h stands for 2^h values. A full level is sorted and every other value moves up,	*/
+/* starting at a random one. Memory is bounded whatever the # of values, small		*/
+/* columns are exact, and sketches merge by adding the levels of one to the other	*/
+/************************************************************************************/
+#define KLLK 256							// capacity of the top level
+#define KLLMIN 64							// least capacity of a level
+#define KLLLEVELS 32
+typedef struct
+{
+	float item[KLLLEVELS][2*KLLK];			// values of each level
+	int size[KLLLEVELS];					// # of values on each level
+	int levels;								// # of levels in use
+	unsigned int coin;						// random bits choosing the values moving up
+	double n;								// # of values added
+} kll;
+typedef struct								// a value and the # of values it stands for
+{
+	float v;
+	double w;
+} weighted;
+/************************************************************************************/
+/* kll_clear:	empties a sketch, the coin is seeded so that graphs are repeatable	*/
+/* parameter: 	seed - the coin, different for each sketch so that they do not all	*/
+/*				toss the same sequence												*/
+/************************************************************************************/
+static void kll_clear(kll* sk, unsigned int seed)
+{
+	memset(sk->size, 0, sizeof(sk->size));
+	sk->levels = 1;
+	sk->coin = seed;
+	sk->n = 0;
+}
+static int float_order(const void* a, const void* b)
+{
+	return *(const float*)a<*(const float*)b?-1:*(const float*)a>*(const float*)b;
+}
+static int weighted_order(const void* a, const void* b)
+{
+	return float_order(&((const weighted*)a)->v, &((const weighted*)b)->v);
+}
+/************************************************************************************/
+/* kll_compact:	moves half of each full level up one level, the lower levels		*/
+/*				having a capacity of 2/3 of the one above							*/
+/************************************************************************************/
+static void kll_compact(kll* sk)
+{
+	int h, i, cap, keep, half;
+	float* lv;
+	for(h=0;h<sk->levels && h<KLLLEVELS-1;h++)
+	{
+		cap = KLLK*pow(2.0/3.0, sk->levels-1-h);
+		if(sk->size[h]<(cap>KLLMIN?cap:KLLMIN)) continue;
+		lv = sk->item[h];
+		qsort(lv, sk->size[h], sizeof(float), float_order);
+		keep = sk->size[h]&1;				// an odd one out stays
+		half = sk->size[h]/2;
+		sk->coin = sk->coin*1103515245+12345;
+		for(i=0;i<half;i++)
+			sk->item[h+1][sk->size[h+1]++] = lv[keep+2*i+((sk->coin>>16)&1)];
+		sk->size[h] = keep;
+		if(h+1==sk->levels) sk->levels++;
 	}
-	if(DEBUG)printf("loaded %d values from file %s\n", count, filename);
 }
 /************************************************************************************/
-/* determine_filesize: 	computes # of float values in input file					*/
-/* parameter: 			infil - file pointer to data file							*/
-/* returns: 			# of float values in infil									*/
+/* kll_add:		adds a value standing for 2^h values to a sketch					*/
+/************************************************************************************/
+static void kll_add(kll* sk, int h, float v)
+{
+	sk->item[h][sk->size[h]++] = v;
+	sk->n += (double)(1<<h);
+	if(h>=sk->levels) sk->levels = h+1;
+	if(sk->size[h]>=KLLMIN) kll_compact(sk);
+}
+/************************************************************************************/
+/* kll_merge:	adds the values of one sketch to another							*/
+/************************************************************************************/
+static void kll_merge(kll* to, kll* from)
+{
+	int h, i;
+	for(h=0;h<from->levels;h++)
+		for(i=0;i<from->size[h];i++)
+			kll_add(to, h, from->item[h][i]);
+}
+/************************************************************************************/
+/* kll_quantiles:	finds quantiles of the values in a sketch						*/
+/* parameter: 		q, nq - the quantiles, in increasing order						*/
+/* parameter: 		out - the values at the quantiles								*/
+/* parameter: 		all - room for KLLLEVELS*2*KLLK values, to sort them in			*/
 /************************************************************************************/
-static int determine_filesize(FILE* infil)
+static void kll_quantiles(kll* sk, const float* q, int nq, float* out, weighted* all)
 {
-	int i=0, count=0, islegal=0, errors=0;
-	char ctmp, buf[FBUFMAX];
-	if(DEBUG)printf("counting values...");
-	while((ctmp=getc(infil))!=EOF)
+	int h, i, k, m=0;
+	double sum=0;
+	for(m=0, h=0;h<sk->levels;h++)
+		for(i=0;i<sk->size[h];i++, m++)
+			all[m] = (weighted){sk->item[h][i], (double)(1<<h)};
+	qsort(all, m, sizeof(weighted), weighted_order);
+	for(i=0, k=0;k<nq;k++)					// the first value reaching each rank
 	{
-		if(strchr(LEGAL, ctmp))
+		for(;i<m-1 && sum+all[i].w<q[k]*sk->n;i++)
+			sum += all[i].w;
+		out[k] = m?all[i].v:0;
+	}
+}
+/************************************************************************************/
+/* input scanning: a single pass over the input, tokenizing and parsing floats		*/
+/* straight out of the (mapped) input. Token rules are those of LEGAL and FBUFMAX	*/
+/************************************************************************************/
+typedef struct								// tokenizer state, kept across chunks
+{
+	char buf[FBUFMAX];						// current token
+	int i;									// length of current token
+	int islegal;							// 1 while inside a token
+	int errors;								// # of skipped non-floats
+	int field;								// field of the current row, reading columns
+	int taken;								// 1 once the field has given its value
+} scanner;
+typedef struct								// growable value buffer, spills to disk
+{
+	float* data;							// values held in memory
+	int size;								// # of values in memory
+	int cap;								// capacity of data
+	int spill;								// spill file descriptor, -1 if none
+	int spilled;							// # of values moved to the spill file
+} fbuf;
+static unsigned char legal_map[256];		// lookup table version of LEGAL
+static const double POW10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+	1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+/************************************************************************************/
+/* init_legal: 	builds the lookup table from LEGAL. The terminating '\0' is			*/
+/*				included since strchr(LEGAL, '\0') matches it						*/
+/************************************************************************************/
+static void init_legal()
+{
+	int i;
+	for(i=0;i<=(int)strlen(LEGAL);i++)
+		legal_map[(unsigned char)LEGAL[i]] = 1;
+}
+/************************************************************************************/
+/* setup:		builds the tables and picks the kernel, once for all threads		*/
+/************************************************************************************/
+static pthread_once_t setup_once = PTHREAD_ONCE_INIT;
+static void setup_all()
+{
+	init_legal();
+	pick_kernel();
+}
+static void setup()
+{
+	pthread_once(&setup_once, setup_all);
+}
+/************************************************************************************/
+/* parse_double:	converts a token to double, giving the same result as atof		*/
+/* parameter: 		s - the token, n - its length (not terminated)					*/
+/*					uses exact double arithmetic when possible, atof otherwise		*/
+/************************************************************************************/
+static double parse_double(const char* s, int n)
+{
+	unsigned long long mant=0;
+	int p=0, neg=0, digits=0, exp10=0, any=0;
+	char tmp[FBUFMAX+1];
+	double val;
+	if(p<n && s[p]=='-'){neg=1;p++;}
+	for(;p<n && isdigit((unsigned char)s[p]);p++,any=1)
+		if(mant||s[p]!='0'){mant = mant*10+(s[p]-'0');digits++;}
+	if(p<n && s[p]=='.')
+		for(p++;p<n && isdigit((unsigned char)s[p]);p++,any=1)
 		{
-			if(i>=FBUFMAX){errors++;i=0;islegal=0;}
-			else
-			{
-				buf[i++] = ctmp;
-				islegal=1;
-			}
+			if(mant||s[p]!='0'){mant = mant*10+(s[p]-'0');digits++;}
+			exp10++;
 		}
-		else
+	if(!any) return 0;						// nothing converted, atof returns 0
+	if(digits>15 || exp10>22)				// not exact in a double, let libc do it
+	{
+		memcpy(tmp, s, n);
+		tmp[n] = '\0';
+		return atof(tmp);
+	}
+	val = (double)mant/POW10[exp10];		// a single, correctly rounded operation
+	return neg?-val:val;
+}
+/************************************************************************************/
+/* parse_float:	converts a token to float, giving the same result as atof			*/
+/************************************************************************************/
+static float parse_float(const char* s, int n)
+{
+	return parse_double(s, n);
+}
+/************************************************************************************/
+/* arena_alloc:	hands out n bytes of scratch memory, valid until the next reset.	*/
+/*				When the block is full a block twice the size is started			*/
+/************************************************************************************/
+static void* arena_alloc(arena* a, size_t n)
+{
+	void* p;
+	n = (n+63)&~(size_t)63;					// cache line aligned
+	if(a->used+n>a->cap)
+	{
+		if(a->block)
 		{
-			if(islegal)
-			{
-				count++;
-				islegal=0;
-			}
-			else
-				errors++;
-			i=0;
+			if(a->noutgrown>=ARENABLOCKS) aerror();
+			a->outgrown[a->noutgrown++] = a->block;
 		}
+		a->cap = 2*a->cap>n?2*a->cap:2*n;
+		if(a->cap<ARENAMIN) a->cap = ARENAMIN;
+		if(!(a->block=(char*)malloc(a->cap))) aerror();
+		a->used = 0;
 	}
-	if(errors)derror(errors);
-	if(DEBUG)printf("found %d...", count);
-	return count;
+	p = a->block+a->used;
+	a->used += n;
+	a->total += n;
+	return p;
 }
 /************************************************************************************/
-/* load:		loads values from file to local global buffer						*/
-/* parameter: 	filename - name of file containing values							*/
-/* returns: 	number of values read from file and size of buffer					*/
+/* arena_reset:	takes back all scratch memory. If the last render outgrew the		*/
+/*				block, one block of all it used replaces them, so that renders of	*/
+/*				the same size allocate nothing										*/
 /************************************************************************************/
-float* load(char* filename, int* buf_size)
+static void arena_reset(arena* a)
 {
-    FILE* infil;
-	float* ret_buf=NULL;
-    printf("file: %s ", filename);
-    infil = fopen(filename, "r");
-    if(!infil)
-    {
-		f_error(filename, "cannot open file");
-    	exit(-1);
-    }
-    else
-    {
-		*buf_size = determine_filesize(infil);
-		if(*buf_size>MEMMAX)merror(filename, *buf_size);
-		if(*buf_size<=0) f_error(filename, "no values found in file");
-		//if(ret_buf)free(ret_buf);
-		ret_buf = (float*)malloc(*buf_size*sizeof(float));
-		load_csv(ret_buf, infil, filename);
-		printf("%d values found.\n", *buf_size);
-		if(DEBUG)print_data(ret_buf, *buf_size);
-		fclose(infil);
-    }
-    return ret_buf;
-}
-/************************************************************************************/
-/* findmax: 	finds maximum value in buf											*/
-/* parameter: 	buf - the buffer containing values									*/
-/* parameter: 	size - the buffer size												*/
-/*				returns maxumum value if possible, FLT_MIN otherwise				*/
+	if(a->noutgrown)
+	{
+		while(a->noutgrown)
+			free(a->outgrown[--a->noutgrown]);
+		free(a->block);
+		a->cap = a->total>ARENAMIN?a->total:ARENAMIN;
+		if(!(a->block=(char*)malloc(a->cap))) aerror();
+	}
+	a->used = 0;
+	a->total = 0;
+}
+/************************************************************************************/
+/* spill:		moves the values held in memory to the spill file, which is			*/
+/*				created (and unlinked) in TMPDIR on first use						*/
+/* parameter: 	out - the value buffer												*/
 /************************************************************************************/
-static float findmax(float* buf, int size)
+static void spill(fbuf* out)
 {
-	int i;
-	maxval = FLT_MIN;
-	for(i=0;i<size;i++)
-		if(maxval<buf[i])
-			maxval = buf[i];
-	return maxval;
+	char name[4096];
+	char* dir = getenv("TMPDIR");
+	size_t len = out->size*sizeof(float), done=0;
+	ssize_t n=0;
+	if(out->spill<0)
+	{
+		snprintf(name, sizeof(name), "%s/graphXXXXXX", dir?dir:"/tmp");
+		if((out->spill = mkstemp(name))<0) merror(name, out->size);
+		unlink(name);
+		if(DEBUG)printf("spilling to %s...", name);
+	}
+	for(;done<len;done+=n)
+		if((n=write(out->spill, (char*)out->data+done, len-done))<=0)
+			merror("spill file", out->spilled+out->size);
+	out->spilled += out->size;
+	out->size = 0;
 }
 /************************************************************************************/
-/* findmin: 	finds minimum value in buf											*/
-/* parameter: 	buf - the buffer containing values									*/
-/* parameter: 	size - the buffer size												*/
-/*				returns minimum value if possible, FLT_MAX otherwise				*/
+/* push:		appends a value to a growable buffer								*/
+/*				once MEMMAX values are held in memory, they are spilled to disk		*/
 /************************************************************************************/
-static float findmin(float* buf, int size)
+static void push(fbuf* out, float val)
 {
-	int i;
-	minval = FLT_MAX;
-	for(i=0;i<size;i++)
-		if(minval>buf[i])
-			minval = buf[i];
-	return minval;
+	if(out->size>=out->cap)
+	{
+		if(out->cap>=MEMMAX) spill(out);
+		else
+		{
+			out->cap = out->cap?2*out->cap:4096;
+			out->data = (float*)realloc(out->data, out->cap*sizeof(float));
+			if(!out->data) aerror();
+		}
+	}
+	out->data[out->size++] = val;
 }
 /************************************************************************************/
-/* print_xscale: 	draws the x-axis and scale of the graph							*/
-/* parameter: 		xratio - the ratio between # of datapoints and graph width		*/
+/* settle:		makes the values of a buffer contiguous, either in memory or by		*/
+/*				mapping the spill file												*/
+/* parameter: 	ctx - the context owning the values									*/
+/* parameter: 	out - the value buffer												*/
+/* parameter: 	k - the series the values belong to									*/
+/* returns: 	the values															*/
 /************************************************************************************/
-static void print_xscale(float xratio)
+static float* settle(graph_ctx* ctx, fbuf* out, int k)
 {
-	int i;
-	printf("%4c", ' ');						// padding before x-scale lines
-	for(i=0 ; i<SCREEN_WIDTH; i++)			// print x-scale lines
-		if(i%10==0)
-			printf("|");
-		else
-			printf(" ");
-	printf("\n%4c", ' ');					// padding before x-scale values
-		for(i=0 ; i<SCREEN_WIDTH; i++)		// print x-scale values
-			if(i%10==0)
-				printf("%-10.0f", i*xratio);
-	printf("\n");
+	void* map;
+	if(!out->data && !(out->data=(float*)malloc(sizeof(float)))) aerror();
+	ctx->values[k] = out->data;				// kept, and grown into, by the next load
+	ctx->values_cap[k] = out->cap?out->cap:1;
+	if(out->spill<0)						// everything fits in memory
+		return ctx->values[k];
+	spill(out);
+	map = mmap(NULL, out->spilled*sizeof(float), PROT_READ, MAP_SHARED, out->spill, 0);
+	close(out->spill);
+	if(map==MAP_FAILED) merror("spill file", out->spilled);
+	ctx->spill_map[k] = (float*)map;
+	ctx->spill_len[k] = out->spilled*sizeof(float);
+	return ctx->spill_map[k];
 }
 /************************************************************************************/
-/* squeeze:		compresses buffer to fit within output buffer, using averages		*/
-/* parameters: 	out_buf 		output buffer										*/
-/* parameters: 	desired_size	size of output buffer								*/
-/* returns: 	ratio between # of data points in file and desired_size				*/
+/* unload:		drops the values loaded by a context. The value buffers are kept	*/
+/*				for the next load to fill, see discard								*/
 /************************************************************************************/
-static float squeeze(float* in_buf, int orig_size, float* out_buf, int desired_size)
+static void unload(graph_ctx* ctx)
 {
-	float ratio = (float)orig_size / (float)desired_size;
-	float average, i;
-	int k, m=0;
-	if(DEBUG)
-		printf("orig_size=%d, des_size=%d, ratio=%f\n", orig_size, desired_size, ratio);
-	for(i=0; i<orig_size; i+=ratio)
+	int k;
+	for(k=0;k<SERIESMAX;k++)
 	{
-		average = 0;
-		for(k=i;k<i+ratio;k++)
-			average += in_buf[k];
-		out_buf[m++]=average/ratio;
+		if(ctx->spill_map[k]) munmap(ctx->spill_map[k], ctx->spill_len[k]);
+		ctx->spill_map[k] = NULL;
 	}
-	if(DEBUG)print_data(out_buf, m);
-	return ratio;
+	if(ctx->index_map.map) munmap(ctx->index_map.map, ctx->index_map.len);
+	ctx->index_map.values = NULL;
+	ctx->index_map.map = NULL;
+	free(ctx->times);
+	ctx->times = NULL;
 }
 /************************************************************************************/
-/* squeeze2:	compresses buffer to fit within output buffer, using selection		*/
-/* parameters: 	out_buf 		output buffer										*/
-/* parameters: 	desired_size	size of output buffer								*/
-/* returns: 	ratio between # of data points in file and desired_size				*/
+/* discard:		frees everything a context owns, but not the context				*/
 /************************************************************************************/
-static float squeeze2(float* in_buf, int orig_size, float* out_buf, int desired_size)
+static void discard(graph_ctx* ctx)
 {
-	float ratio = (float)orig_size / (float)desired_size;
-	float i;
-	int m=0;
-	if(DEBUG)
-		printf("buf_size=%d, des_size=%d, ratio=%f\n", orig_size, desired_size, ratio);
-	for(i=0; i<orig_size; i+=ratio)
+	int k;
+	unload(ctx);
+	for(k=0;k<SERIESMAX;k++)
 	{
-		out_buf[m++]=in_buf[(int)i];
+		free(ctx->values[k]);
+		ctx->values[k] = NULL;
+		ctx->values_cap[k] = 0;
 	}
-	if(DEBUG)print_data(out_buf, m);
-	return ratio;
+	arena_reset(&ctx->scratch);
+	free(ctx->scratch.block);
+	memset(&ctx->scratch, 0, sizeof(arena));
+	free(ctx->screen.data);
+	free(ctx->shown.data);
+	free(ctx->delta.data);
+	memset(&ctx->screen, 0, sizeof(frame));
+	memset(&ctx->shown, 0, sizeof(frame));
+	memset(&ctx->delta, 0, sizeof(frame));
 }
-float compress(float* buf, int size, float* copy)
+/************************************************************************************/
+/* release:		hands the pages of buf[from..to) back to the OS when buf is mapped	*/
+/*				from the spill file. They are read back in if touched again			*/
+/************************************************************************************/
+static void release(graph_ctx* ctx, float* buf, int from, int to)
 {
-	float xratio=1;
-	int i;
-	if(size>SCREEN_WIDTH)				// more data points than positions on x-axis?
+	size_t page = sysconf(_SC_PAGESIZE);
+	char* lo = (char*)(((size_t)(buf+from)+page-1)&~(page-1));
+	char* hi = (char*)((size_t)(buf+to)&~(page-1));
+	int k;
+	for(k=0;k<SERIESMAX && lo<hi;k++)
+		if(buf==ctx->spill_map[k])
+			madvise(lo, hi-lo, MADV_DONTNEED);
+}
+/************************************************************************************/
+/* scan: 		tokenizes a chunk of input and appends the values found				*/
+/* parameter: 	sc - tokenizer state, carried over from the previous chunk			*/
+/* parameter: 	p, end - the chunk													*/
+/* parameter: 	out - the value buffer												*/
+/************************************************************************************/
+static void scan(scanner* sc, const char* p, const char* end, fbuf* out)
+{
+	for(;p<end;p++)
 	{
-		if(compression==1)
-			xratio = squeeze(buf, size, copy, SCREEN_WIDTH);// squeeze using averages...
+		if(legal_map[(unsigned char)*p])
+		{
+			if(sc->i>=FBUFMAX){sc->errors++;sc->i=0;sc->islegal=0;}
+			else
+			{
+				sc->buf[sc->i++] = *p;
+				sc->islegal=1;
+			}
+		}
 		else
-			xratio = squeeze2(buf, size, copy, SCREEN_WIDTH);//...or selection
+		{
+			if(sc->islegal)
+			{
+				push(out, parse_float(sc->buf, sc->i));
+				if(DEBUG) printf("out_buf[%d]=%f, ", out->size-1, out->data[out->size-1]);
+				sc->islegal=0;
+			}
+			else
+				sc->errors++;
+			sc->i=0;
+		}
 	}
-	else
-		for(i=0;(i<size)&&(i<SCREEN_WIDTH);i++)				// or simple copy
-			copy[i]=buf[i];
-	return xratio;
 }
 /************************************************************************************/
-/* _graph: 		draws a graph of data values in buf of size size					*/
-/* parameter: 	buf - the buffer containing values									*/
-/* parameter: 	size - the buffer size												*/
+/* scan_rows: 	tokenizes a chunk of rows, appending the first value of each		*/
+/*				selected field to the buffer of its series							*/
+/* parameter: 	sc - tokenizer state, carried over from the previous chunk			*/
+/* parameter: 	p, end - the chunk													*/
+/* parameter: 	out - the value buffers, one per series								*/
+/* parameter: 	pick - series of each field, -1 if the field is not drawn			*/
+/*				fields are separated by ',', ';' or tab and rows by newline. A		*/
+/*				field without a value, like a header, adds nothing to its series	*/
 /************************************************************************************/
-static void _graph(float *buf, int size)
+static void scan_rows(scanner* sc, const char* p, const char* end, fbuf* out, const signed char* pick)
 {
-	int i, k, m, origotime=1, kflag=0, mflag=0;
-	float step=1.0, xratio=1;
-	float *copy = (float*)malloc((size>SCREEN_WIDTH?SCREEN_WIDTH:size)*sizeof(float));
-	xratio = compress(buf, size, copy);					// compress if needed
-	maxval = findmax(buf,size);							// find highest value in set
-	minval = findmin(buf,size);							// find lowest value in set
-														// compute y-ratio
-	step = ((maxval>0?maxval:0)-(minval>0?0:minval))/(float)SCREEN_HEIGHT;
-	step = (maxval-(minval>0?0:minval))/(float)SCREEN_HEIGHT;
-	printf("%4c\n",'Y');
-	for(k=0;k<=SCREEN_HEIGHT;k++)
-	{
-		kflag=fabs(maxval-step*k)>KILO?1:0;					// large number (>1000)
-		mflag=fabs(maxval-step*k)>MEGA?1:0;					// larger number (>1000000)
-		// ------------------------------------------------Y-axis drawing, 3 cases:
-		if(origotime&&(maxval-step*k)<=0)				// case 1: origo, i.e. draw '0'
-			{printf("%3d_|", 0);}						// and a line		
-		else if((k%5==0)&&(fabs(maxval-step*k)>0.5)) 	// case 2: draw label + line
-			printf("%3.0f%c|", 	round(mflag?(maxval-step*k)/MEGA: 
-								kflag?(maxval-step*k)/KILO:	maxval-step*k), 
-								mflag?'M': kflag?'k': ' ');
-		else printf("%5c", '|');						// case 3: draw just the line
-
-		for(i=0 ; i<SCREEN_WIDTH&&i<size; i++)			// Plot data points top-down
+	for(;p<end;p++)
+	{
+		if(legal_map[(unsigned char)*p])
 		{
-			if(copy[i]>=(maxval-step*k) && copy[i]!=USED) // if value is high enough
-			{											// and is not plotted before
-				printf("%c", stylechar);				// plot the value using stylechar
-				copy[i] = USED;							// Mark value as used
-			}
-			else										// if no value should be plotted
+			if(sc->i>=FBUFMAX){sc->errors++;sc->i=0;sc->islegal=0;}
+			else
 			{
-				if(origotime&&(maxval-step*(k))<=0)printf("_"); // X-axis drawing
-				else printf(" ");								// or nothing
+				sc->buf[sc->i++] = *p;
+				sc->islegal=1;
 			}
+			continue;
 		}
-		if(origotime&&(maxval-step*(k))<=0)				// case 1 cont'd: rest of X-axis
+		if(sc->islegal)
 		{
-			for(m=i;m<SCREEN_WIDTH;m++)
-				printf("_");
-			printf("X (%d)", size<SCREEN_WIDTH?SCREEN_WIDTH:size);
-			origotime=0;
+			if(sc->taken) sc->errors++;		// a second value in the field
+			else if(sc->field<COLMAX && pick[sc->field]>=0)
+				push(&out[(int)pick[sc->field]], parse_float(sc->buf, sc->i));
+			sc->taken=1;
+			sc->islegal=0;
 		}
-		printf("\n");
+		else if(*p!=',' && *p!=';' && *p!='\t' && *p!='\n')
+			sc->errors++;
+		sc->i=0;
+		if(*p=='\n'){sc->field=0;sc->taken=0;}
+		else if(*p==',' || *p==';' || *p=='\t'){sc->field++;sc->taken=0;}
 	}
-	print_xscale(xratio);								// Draw the X-scale
-	if(DEBUG)printf("maxval=%f, SCREEN_WIDTH=%d, SCREEN_HEIGHT=%d, step=%f, xratio=%f\n", maxval, SCREEN_WIDTH, SCREEN_HEIGHT, step, xratio);
-	free(copy);
 }
 /************************************************************************************/
-/* graph: 		draws a graph of data values in buf of size size					*/
-/* parameter: 	buf - the buffer containing values									*/
-/* parameter: 	size - the buffer size												*/
-/*				calls _graph for actual work										*/
+/* parallel scanning: the input is cut into ranges ending just after a non-LEGAL	*/
+/* character, where the tokenizer state is known to be empty, so every range can	*/
+/* be parsed by its own thread and the values appended in order						*/
 /************************************************************************************/
-void graph(float *buf, int size)
+typedef struct								// a range of input parsed by one thread
 {
-	printf("graph \u14B7 Copyright (C) 2017 Martin Blom\n");
-	_graph(buf, size);
+	const char *p, *end;
+	scanner sc;
+	fbuf out;
+	int threaded;							// 1 if parsed by a thread of its own
+} part;
+static void* scan_part(void* arg)
+{
+	part* w = (part*)arg;
+	scan(&w->sc, w->p, w->end, &w->out);
+	return NULL;
 }
 /************************************************************************************/
-/* set_style:	sets the character used to represent data points					*/
-/* parameter: 	the character to be used											*/
-/*				if the character is non-standard-ASCII, it is set to '?'			*/
+/* append:		appends n values to a growable buffer, see push						*/
+/************************************************************************************/
+static void append(fbuf* out, const float* val, int n)
+{
+	int k;
+	while(n>0)
+	{
+		if(out->size>=out->cap)				// let push grow or spill the buffer
+		{
+			push(out, *val++);
+			n--;
+			continue;
+		}
+		k = out->cap-out->size<n?out->cap-out->size:n;
+		memcpy(out->data+out->size, val, k*sizeof(float));
+		out->size += k;
+		val += k;
+		n -= k;
+	}
+}
+/************************************************************************************/
+/* scan_parallel:	tokenizes mapped input on several threads, a round of ranges	*/
+/*					at a time, giving the same values and errors as scan			*/
+/* parameter: 		sc - tokenizer state											*/
+/* parameter: 		map, size - the input											*/
+/* parameter: 		out - the value buffer											*/
+/* parameter: 		threads - # of threads											*/
 /************************************************************************************/
-void set_style(char style)
+static void scan_parallel(scanner* sc, char* map, off_t size, fbuf* out, int threads)
 {
-	stylechar = style;
+	part* w = (part*)calloc(threads, sizeof(part));
+	pthread_t* tid = (pthread_t*)malloc(threads*sizeof(pthread_t));
+	off_t pos=0, len=2*(off_t)(MEMMAX-1);	// a range holds at most MEMMAX values,
+	char* q;								// so the workers never spill
+	int t, n;
+	if(!w || !tid) aerror();
+	for(t=0;t<threads;t++)
+		w[t].out.spill = -1;
+	while(pos<size)
+	{
+		for(n=0;n<threads && pos<size;n++)	// cut a round of ranges
+		{
+			w[n].p = map+pos;
+			q = size-pos>len?map+pos+len:map+size;
+			while(q<map+size && legal_map[(unsigned char)q[-1]]) q++;
+			w[n].end = q;
+			memset(&w[n].sc, 0, sizeof(scanner));
+			w[n].out.size = 0;
+			w[n].threaded = !pthread_create(&tid[n], NULL, scan_part, &w[n]);
+			if(!w[n].threaded) scan_part(&w[n]);
+			pos = q-map;
+		}
+		for(t=0;t<n;t++)					// collect the round in order
+		{
+			if(w[t].threaded) pthread_join(tid[t], NULL);
+			append(out, w[t].out.data, w[t].out.size);
+			sc->errors += w[t].sc.errors;
+		}
+		*sc = (scanner){{0}, w[n-1].sc.i, w[n-1].sc.islegal, sc->errors};
+		madvise(map, pos, MADV_DONTNEED);
+	}
+	for(t=0;t<threads;t++)
+		free(w[t].out.data);
+	free(w);
+	free(tid);
 }
-void set_unistyle(char* style)
+/************************************************************************************/
+/* scan_file: 	reads all values in a file in one pass								*/
+/* parameter: 	fd - descriptor of the input										*/
+/* parameter: 	sc - tokenizer state												*/
+/* parameter: 	out - the value buffer, one per series when reading columns			*/
+/* parameter: 	threads - # of threads parsing regular files						*/
+/* parameter: 	pick - series of each field, see scan_rows, NULL to read all values	*/
+/*				regular files are memory mapped, pipes are read in chunks. Columns	*/
+/*				are read on a single thread											*/
+/* returns: 	# of bytes scanned													*/
+/************************************************************************************/
+static long long scan_file(int fd, scanner* sc, fbuf* out, int threads, const signed char* pick)
 {
-	printf("not implemented\n");
+	struct stat st;
+	char* map=MAP_FAILED;
+	char chunk[65536];
+	ssize_t n;
+	off_t pos, len;
+	long long bytes=0;
+	if(fstat(fd, &st)==0 && S_ISREG(st.st_mode) && st.st_size>0)
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if(map!=MAP_FAILED)
+	{
+		madvise(map, st.st_size, MADV_SEQUENTIAL);
+		if(threads>1 && !pick) scan_parallel(sc, map, st.st_size, out, threads);
+		else for(pos=0;pos<st.st_size;pos+=len)	// scanned pages are dropped as we go
+		{
+			len = st.st_size-pos<CHUNK*(off_t)sizeof(float)?st.st_size-pos:CHUNK*(off_t)sizeof(float);
+			if(pick) scan_rows(sc, map+pos, map+pos+len, out, pick);
+			else scan(sc, map+pos, map+pos+len, out);
+			madvise(map+pos, len, MADV_DONTNEED);
+		}
+		munmap(map, st.st_size);
+		return st.st_size;
+	}
+	for(;(n=read(fd, chunk, sizeof(chunk)))>0;bytes+=n)
+		if(pick) scan_rows(sc, chunk, chunk+n, out, pick);
+		else scan(sc, chunk, chunk+n, out);
+	return bytes;
 }
 /************************************************************************************/
-/* set_width:	sets the width of the graph	(in characters)							*/
-/* parameter: 	s - the width														*/
-/*				if size is wrong, the program exits									*/
+/* index files: file.graphidx holds the values of file as floats, followed by a		*/
+/* pyramid of sum/min/max aggregates over blocks of 2^IDXBASE, 2^(IDXBASE+1), ...	*/
+/* values. A column of any width is then answered from a few blocks					*/
 /************************************************************************************/
-void set_width(int s)
+typedef struct								// header of an index file
 {
-	if(s > WMAX) serror("width too large", s);
-	SCREEN_WIDTH = s;
+	char magic[8];							// "GRAPHIDX"
+	int version;							// IDXVERSION
+	int errors;								// # of non-floats skipped in the source
+	long long count;						// # of values
+	long long mtime;						// modification time of the source (ns)
+	long long srcsize;						// size of the source (bytes)
+	int levels;								// # of pyramid levels
+	int pad;
+} idxhead;
+/************************************************************************************/
+/* index_layout:	computes the position of each level in an index file			*/
+/* parameter: 		count - # of values												*/
+/* parameter: 		off - set to the offset of each level							*/
+/* returns: 		# of levels, off[levels] is the size of the file				*/
+/************************************************************************************/
+static int index_layout(long long count, size_t* off)
+{
+	int l;
+	long long n = (count+(1<<IDXBASE)-1)>>IDXBASE;
+	off[0] = sizeof(idxhead)+count*sizeof(float);
+	for(l=0;n>0&&l<31;l++,n=n>1?(n+1)/2:0)
+		off[l+1] = off[l]+n*sizeof(span);
+	return l;
 }
 /************************************************************************************/
-/* set_height:	sets the height of the graph	(in characters)						*/
-/* parameter: 	s - the height														*/
-/*				if size is wrong, the program exits									*/
+/* index_name:	names the index of a file											*/
 /************************************************************************************/
-void set_height(int s)
+static void index_name(char* filename, char* name, size_t len)
 {
-	if(s > HMAX) serror("height too large", s);
-	SCREEN_HEIGHT = s;
+	snprintf(name, len, "%s.graphidx", filename);
 }
 /************************************************************************************/
-/* set_compression:	sets the compression scheme for the data values					*/
-/* parameter: 	c - 'a' for average, 's' for select									*/
-/*				if c is neither 'a' or 's', select is chosen as default				*/
+/* index_open:	maps the index of a file if it is up to date						*/
+/* parameter: 	ctx - the context the index is loaded into							*/
+/* parameter: 	filename - name of the indexed file									*/
+/* parameter: 	buf_size - set to the # of values									*/
+/* parameter: 	errors - set to the # of non-floats skipped in the file				*/
+/* returns: 	the values, or NULL if there is no usable index						*/
 /************************************************************************************/
-void set_compression(char c)
+static float* index_open(graph_ctx* ctx, char* filename, int* buf_size, int* errors)
 {
-	if(c=='a') compression = 1;
-	else if(c=='s') compression = 2;
-	else cerror();
-}
\ No newline at end of file
+	char name[4096];
+	struct stat src, st;
+	size_t off[33];
+	idxhead* head;
+	char* map;
+	int fd, l;
+	index_name(filename, name, sizeof(name));
+	if(stat(filename, &src) || (fd=open(name, O_RDONLY))<0) return NULL;
+	if(fstat(fd, &st) || st.st_size<(off_t)sizeof(idxhead) ||
+		(map=mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0))==MAP_FAILED)
+	{
+		close(fd);
+		return NULL;
+	}
+	close(fd);
+	head = (idxhead*)map;
+	if(memcmp(head->magic, "GRAPHIDX", 8) || head->version!=IDXVERSION ||
+		head->srcsize!=src.st_size || head->mtime!=src.st_mtim.tv_sec*1000000000LL+src.st_mtim.tv_nsec ||
+		head->count>INT_MAX || head->levels!=index_layout(head->count, off) || (size_t)st.st_size!=off[head->levels])
+	{
+		if(DEBUG)printf("index %s is stale...", name);
+		munmap(map, st.st_size);
+		return NULL;
+	}
+	unload(ctx);
+	ctx->index_map.map = map;
+	ctx->index_map.len = st.st_size;
+	ctx->index_map.values = (float*)(map+sizeof(idxhead));
+	ctx->index_map.levels = head->levels;
+	for(l=0;l<head->levels;l++)
+		ctx->index_map.level[l] = (span*)(map+off[l]);
+	*buf_size = head->count;
+	*errors = head->errors;
+	return ctx->index_map.values;
+}
+/************************************************************************************/
+/* index_write:	writes the index of a file, via a temporary file that replaces		*/
+/*				any old index once complete											*/
+/* parameter: 	filename - name of the indexed file									*/
+/* parameter: 	src - status of the file when it was read							*/
+/* parameter: 	buf, size - the values of the file									*/
+/* parameter: 	errors - # of non-floats skipped in the file						*/
+/************************************************************************************/
+static void index_write(char* filename, struct stat* src, float* buf, int size, int errors)
+{
+	char name[4096], tmp[4096+16];
+	size_t off[33];
+	long long i, n, from;
+	idxhead* head;
+	span *lo, *hi;
+	char* map;
+	int fd, l, levels = index_layout(size, off);
+	index_name(filename, name, sizeof(name));
+	snprintf(tmp, sizeof(tmp), "%s.XXXXXX", name);
+	if((fd=mkstemp(tmp))<0){f_error(name, "cannot write index");return;}
+	if(fchmod(fd, 0644) || ftruncate(fd, off[levels]) ||
+		(map=mmap(NULL, off[levels], PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0))==MAP_FAILED)
+	{
+		f_error(name, "cannot write index");
+		close(fd);
+		unlink(tmp);
+		return;
+	}
+	close(fd);
+	head = (idxhead*)map;
+	memcpy(head->magic, "GRAPHIDX", 8);
+	head->version = IDXVERSION;
+	head->errors = errors;
+	head->count = size;
+	head->mtime = src->st_mtim.tv_sec*1000000000LL+src->st_mtim.tv_nsec;
+	head->srcsize = src->st_size;
+	head->levels = levels;
+	head->pad = 0;
+	memcpy(map+sizeof(idxhead), buf, size*sizeof(float));
+	for(l=0;l<levels;l++)
+	{
+		hi = (span*)(map+off[l]);
+		n = (off[l+1]-off[l])/sizeof(span);
+		if(l==0)								// bottom level from the values
+			for(i=0;i<n;i++)
+			{
+				from = i<<IDXBASE;
+				reduce(buf+from, size-from<(1<<IDXBASE)?size-from:(1<<IDXBASE), &hi[i]);
+			}
+		else									// other levels from the one below
+			for(i=0,lo=(span*)(map+off[l-1]);i<n;i++)
+			{
+				hi[i] = lo[2*i];
+				if(2*i+1<(long long)((off[l]-off[l-1])/sizeof(span)))
+				{
+					hi[i].sum = hi[i].sum+lo[2*i+1].sum;
+					hi[i].min = MIN2(lo[2*i+1].min, hi[i].min);
+					hi[i].max = MAX2(lo[2*i+1].max, hi[i].max);
+				}
+			}
+	}
+	munmap(map, off[levels]);
+	if(rename(tmp, name)){f_error(name, "cannot write index");unlink(tmp);}
+}
+/************************************************************************************/
+/* query:		aggregates buf[from..to), from the index pyramid when buf holds		*/
+/*				the values of index_map and with the reduction kernel otherwise		*/
+/* parameter: 	out - the aggregate													*/
+/*				the range is split into the largest aligned blocks that fit, so		*/
+/*				at most two blocks per level are read								*/
+/************************************************************************************/
+static void query(pyramid* index_map, float* buf, int from, int to, span* out)
+{
+	int l, n;
+	span* b;
+	span part;
+	if(buf!=index_map->values || to-from<(2<<IDXBASE))
+	{
+		reduce(buf+from, to-from, out);
+		return;
+	}
+	out->sum = 0;
+	out->min = INFINITY;
+	out->max = -INFINITY;
+	while(from<to)
+	{
+		for(l=index_map->levels-1;l>=0;l--)	// largest aligned block within range
+			if(!(from&((1<<(IDXBASE+l))-1)) && to-from>=(1<<(IDXBASE+l)))
+				break;
+		if(l>=0)
+		{
+			b = &index_map->level[l][from>>(IDXBASE+l)];
+			from += 1<<(IDXBASE+l);
+		}
+		else								// values up to the next block
+		{
+			n = (1<<IDXBASE)-(from&((1<<IDXBASE)-1));
+			reduce(buf+from, to-from<n?to-from:n, &part);
+			b = &part;
+			from += to-from<n?to-from:n;
+		}
+		out->sum = out->sum+b->sum;
+		out->min = MIN2(b->min, out->min);
+		out->max = MAX2(b->max, out->max);
+	}
+}
+/************************************************************************************/
+/* compressed input: gzip and zstd input is decompressed by a thread of its own		*/
+/* into a pipe, which the tokenizer reads like any other pipe while the next chunk	*/
+/* is decompressed. Piped input that is not compressed is copied through as is		*/
+/************************************************************************************/
+#define ZCHUNK 262144						// # of bytes decompressed at a time
+typedef struct								// input decompressed by a thread
+{
+	int in;									// the input
+	int out;								// write end of the pipe
+	unsigned char head[4];					// bytes read to detect the format
+	int nhead;								// # of bytes in head not passed on yet
+	char kind;								// 'g' gzip, 'z' zstd, 'p' plain
+} inflater;
+/************************************************************************************/
+/* write_all:	writes n bytes to fd												*/
+/* returns: 	0, or -1 if the reader has gone										*/
+/************************************************************************************/
+static int write_all(int fd, const void* p, size_t n)
+{
+	ssize_t k;
+	for(;n>0;n-=k, p=(const char*)p+k)
+		if((k=write(fd, p, n))<=0) return -1;
+	return 0;
+}
+/************************************************************************************/
+/* read_in:		reads the input of an inflater, starting with the bytes in head		*/
+/* returns: 	# of bytes read, 0 at the end of the input							*/
+/************************************************************************************/
+static ssize_t read_in(inflater* z, unsigned char* buf, size_t cap)
+{
+	int n = z->nhead;
+	if(!n) return read(z->in, buf, cap);
+	memcpy(buf, z->head, n);
+	z->nhead = 0;
+	return n;
+}
+#ifdef HAVE_ZLIB
+/************************************************************************************/
+/* inflate_gzip:	decompresses gzip input, also several members one after another	*/
+/************************************************************************************/
+static void inflate_gzip(inflater* z, unsigned char* in, unsigned char* out)
+{
+	z_stream zs;
+	ssize_t n;
+	int ret;
+	memset(&zs, 0, sizeof(zs));
+	if(inflateInit2(&zs, 15+32)!=Z_OK) return;	// gzip or zlib header
+	for(;;)
+	{
+		if(!zs.avail_in)
+		{
+			if((n=read_in(z, in, ZCHUNK))<=0) break;
+			zs.next_in = in;
+			zs.avail_in = n;
+		}
+		zs.next_out = out;
+		zs.avail_out = ZCHUNK;
+		ret = inflate(&zs, Z_NO_FLUSH);
+		if(ret==Z_NEED_DICT || ret==Z_DATA_ERROR || ret==Z_MEM_ERROR) break;
+		if(write_all(z->out, out, ZCHUNK-zs.avail_out)) break;
+		if(ret==Z_STREAM_END) inflateReset(&zs);	// next member, if any
+	}
+	inflateEnd(&zs);
+}
+#endif
+#ifdef HAVE_ZSTD
+/************************************************************************************/
+/* inflate_zstd:	decompresses zstd input, also several frames one after another	*/
+/************************************************************************************/
+static void inflate_zstd(inflater* z, unsigned char* in, unsigned char* out)
+{
+	ZSTD_DStream* zs = ZSTD_createDStream();
+	ZSTD_inBuffer ib = {in, 0, 0};
+	ZSTD_outBuffer ob;
+	ssize_t n;
+	if(!zs) return;
+	ZSTD_initDStream(zs);
+	while((n=read_in(z, in, ZCHUNK))>0)
+	{
+		ib.size = n;
+		ib.pos = 0;
+		while(ib.pos<ib.size)
+		{
+			ob = (ZSTD_outBuffer){out, ZCHUNK, 0};
+			if(ZSTD_isError(ZSTD_decompressStream(zs, &ob, &ib)) || write_all(z->out, out, ob.pos))
+			{
+				ZSTD_freeDStream(zs);
+				return;
+			}
+		}
+	}
+	ZSTD_freeDStream(zs);
+}
+#endif
+/************************************************************************************/
+/* inflate_thread:	decompresses or copies the input into the pipe until either		*/
+/*					ends, then closes both											*/
+/************************************************************************************/
+static void* inflate_thread(void* arg)
+{
+	inflater* z = (inflater*)arg;
+	unsigned char* in = (unsigned char*)malloc(2*ZCHUNK);	// input, then output
+	sigset_t pipe;
+	ssize_t n;
+	sigemptyset(&pipe);						// a reader that stops early gives EPIPE
+	sigaddset(&pipe, SIGPIPE);				// instead of ending the program
+	pthread_sigmask(SIG_BLOCK, &pipe, NULL);
+	if(in)
+	{
+#ifdef HAVE_ZLIB
+		if(z->kind=='g') inflate_gzip(z, in, in+ZCHUNK);
+#endif
+#ifdef HAVE_ZSTD
+		if(z->kind=='z') inflate_zstd(z, in, in+ZCHUNK);
+#endif
+		if(z->kind=='p')
+			while((n=read_in(z, in, ZCHUNK))>0 && !write_all(z->out, in, n));
+	}
+	free(in);
+	close(z->out);
+	if(z->in!=STDIN_FILENO) close(z->in);
+	free(z);
+	return NULL;
+}
+/************************************************************************************/
+/* open_input: 	opens a file for reading, "-" is stdin. Compressed input is			*/
+/*				decompressed on the fly, see inflater								*/
+/* parameter: 	filename - name of file												*/
+/* parameter: 	raw - 1 for raw values, which are never taken for compressed input	*/
+/* returns: 	file descriptor, the program exits if the file cannot be opened		*/
+/************************************************************************************/
+static int open_input(char* filename, int raw)
+{
+	int fd = strcmp(filename, "-")?open(filename, O_RDONLY):STDIN_FILENO;
+	int p[2];
+	struct stat st;
+	inflater peek = {0}, *z = &peek;			// copied to the heap for a thread only
+	pthread_t tid;
+	ssize_t n;
+	if(fd<0)
+	{
+		f_error(filename, "cannot open file");
+		exit(-1);
+	}
+	if(raw) return fd;						// any bytes can start a raw value
+	if(fstat(fd, &st)==0 && S_ISREG(st.st_mode))	// peek at files, read from pipes
+		n = pread(fd, z->head, 4, lseek(fd, 0, SEEK_CUR));
+	else for(z->nhead=0;z->nhead<4 && (n=read(fd, z->head+z->nhead, 4-z->nhead))>0;z->nhead+=n);
+	n = S_ISREG(st.st_mode)?n:z->nhead;
+	if(n>=4 && !memcmp(z->head, "\x1F\x8B\x08", 3) && !(z->head[3]&0xE0)) z->kind = 'g';
+	else if(n>=4 && !memcmp(z->head, "\x28\xB5\x2F\xFD", 4)) z->kind = 'z';
+	else if(!S_ISREG(st.st_mode)) z->kind = 'p';
+	else return fd;
+#ifndef HAVE_ZLIB
+	if(z->kind=='g'){f_error(filename, "gzip input needs graph built with zlib");exit(-1);}
+#endif
+#ifndef HAVE_ZSTD
+	if(z->kind=='z'){f_error(filename, "zstd input needs graph built with libzstd");exit(-1);}
+#endif
+	if(pipe(p)){f_error(filename, "cannot open pipe");exit(-1);}
+	if(!(z=(inflater*)malloc(sizeof(inflater)))) aerror();
+	*z = peek;
+#ifdef F_SETPIPE_SZ
+	fcntl(p[1], F_SETPIPE_SZ, 4*ZCHUNK);	// room for a few chunks ahead of the reader
+#endif
+	z->in = fd;
+	z->out = p[1];
+	if(pthread_create(&tid, NULL, inflate_thread, z)){f_error(filename, "cannot start thread");exit(-1);}
+	pthread_detach(tid);
+	return p[0];
+}
+/************************************************************************************/
+/* binary_value:	converts a little-endian value of a binary format to float		*/
+/************************************************************************************/
+static float binary_value(const unsigned char* p, int format)
+{
+	uint64_t u=0;
+	uint32_t w;
+	float f;
+	double d;
+	int i;
+	for(i=FORMAT_SIZE[format]-1;i>=0;i--)	// any host byte order
+		u = u<<8|p[i];
+	switch(format)
+	{
+		case 1: w = u; memcpy(&f, &w, 4); return f;
+		case 2: memcpy(&d, &u, 8); return d;
+		case 3: return (int32_t)(uint32_t)u;
+		default: return (int64_t)u;
+	}
+}
+/************************************************************************************/
+/* load_binary:	loads raw values, see load_file. Packed f32 files are mapped and	*/
+/*				compressed where they lie, other layouts are converted as they are	*/
+/*				read, with no text to parse											*/
+/* parameter: 	errors - 1 if the input ends in a partial record					*/
+/************************************************************************************/
+static float* load_binary(graph_ctx* ctx, char* filename, int* buf_size, int* errors)
+{
+	int fd, size=FORMAT_SIZE[ctx->format], stride=ctx->stride?ctx->stride:size;
+	fbuf values = {ctx->values[0], 0, ctx->values_cap[0], -1, 0};
+	unsigned char* chunk;
+	size_t cap=stride>65536?stride:65536/stride*stride, have=0, i, len;
+	ssize_t n;
+	struct stat st;
+	void* map;
+	if(ctx->offset+size>stride) serror("value past the end of the record", ctx->offset);
+	fd = open_input(filename, 1);
+	unload(ctx);
+	if(ctx->format==1 && stride==4 && !fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size>=4
+		&& __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__)	// the file is the buffer
+	{
+		len = st.st_size/4*4;
+		if(len/4>INT_MAX) serror("too many values", INT_MAX);
+		map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if(map==MAP_FAILED) merror(filename, len/4);
+		madvise(map, len, MADV_SEQUENTIAL);
+		ctx->spill_map[0] = (float*)map;		// unmapped, and paged out, as spilled values
+		ctx->spill_len[0] = len;
+		ctx->stats.bytes += len;
+		*buf_size = len/4;
+		*errors = len<(size_t)st.st_size;
+		return ctx->spill_map[0];
+	}
+	if(!(chunk=(unsigned char*)malloc(cap))) aerror();
+	while((n=read(fd, chunk+have, cap-have))>0)
+	{
+		have += n;
+		ctx->stats.bytes += n;
+		for(i=0;i+stride<=have;i+=stride)
+			push(&values, binary_value(chunk+i+ctx->offset, ctx->format));
+		memmove(chunk, chunk+i, have-i);	// keep a partial record for the next read
+		have -= i;
+	}
+	if(fd!=STDIN_FILENO) close(fd);
+	free(chunk);
+	*buf_size = values.spilled+values.size;
+	*errors = have>0;
+	return settle(ctx, &values, 0);
+}
+/************************************************************************************/
+/* loaded:		counts the values loaded since t, see load_file						*/
+/* returns: 	buf																	*/
+/************************************************************************************/
+static float* loaded(graph_ctx* ctx, double t, float* buf, int* buf_size, int* errors)
+{
+	ctx->stats.load += seconds()-t;
+	ctx->stats.values += *buf_size;
+	ctx->stats.skipped += *errors;
+	return buf;
+}
+/************************************************************************************/
+/* load_file:	loads values from file to a buffer owned by the context, quietly	*/
+/* parameter: 	ctx - the context													*/
+/* parameter: 	filename - name of file containing values							*/
+/* parameter: 	buf_size - # of values read											*/
+/* parameter: 	errors - # of non-floats skipped									*/
+/* returns: 	the values															*/
+/************************************************************************************/
+static float* load_file(graph_ctx* ctx, char* filename, int* buf_size, int* errors)
+{
+	int fd;
+	scanner sc = {{0}, 0, 0, 0};
+	fbuf values = {ctx->values[0], 0, ctx->values_cap[0], -1, 0};
+	float* ret_buf;
+	struct stat st;
+	double t=seconds();
+	setup();
+	if(ctx->format)
+		return loaded(ctx, t, load_binary(ctx, filename, buf_size, errors), buf_size, errors);
+	if(ctx->index && strcmp(filename, "-") && (ret_buf=index_open(ctx, filename, buf_size, errors)))
+		return loaded(ctx, t, ret_buf, buf_size, errors);
+	fd = open_input(filename, 0);
+	unload(ctx);
+	if(DEBUG)printf("loading data...");
+	fstat(fd, &st);
+	ctx->stats.bytes += scan_file(fd, &sc, &values, ctx->threads, NULL);
+	if(fd!=STDIN_FILENO) close(fd);
+	*buf_size = values.spilled+values.size;
+	*errors = sc.errors;
+	if(DEBUG)printf("found %d...", *buf_size);
+	ret_buf = settle(ctx, &values, 0);
+	if(ctx->index && S_ISREG(st.st_mode) && *buf_size>0)	// index the file, and use the index
+	{
+		index_write(filename, &st, ret_buf, *buf_size, sc.errors);
+		if(index_open(ctx, filename, buf_size, errors))
+			ret_buf = ctx->index_map.values;
+	}
+	if(DEBUG)print_data(ret_buf, *buf_size);
+	return loaded(ctx, t, ret_buf, buf_size, errors);
+}
+/************************************************************************************/
+/* graph_load:	loads values from file to a buffer owned by the context, valid		*/
+/*				until the next graph_load or graph_destroy. It may be mmapped, so	*/
+/*				the caller never frees it											*/
+/* parameter: 	ctx - the context													*/
+/* parameter: 	filename - name of file containing values							*/
+/* returns: 	number of values read from file and size of buffer					*/
+/************************************************************************************/
+float* graph_load(graph_ctx* ctx, char* filename, int* buf_size)
+{
+	int errors=0;
+	float* ret_buf;
+	printf("file: %s ", filename);
+	ret_buf = load_file(ctx, filename, buf_size, &errors);
+	if(errors)derror(errors);
+	if(*buf_size<=0) f_error(filename, "no values found in file");
+	printf("%d values found.\n", *buf_size);
+	return ret_buf;
+}
+/************************************************************************************/
+/* graph_load_columns:	loads the selected columns of a file in one pass, each		*/
+/*						to a buffer owned by the context, see graph_load			*/
+/* parameter: 			ctx - the context, with the columns set						*/
+/* parameter: 			filename - name of file containing rows of values			*/
+/* parameter: 			bufs, sizes - the values and size of each series			*/
+/* returns: 			# of series loaded											*/
+/************************************************************************************/
+int graph_load_columns(graph_ctx* ctx, char* filename, float** bufs, int* sizes)
+{
+	int fd, k, total=0;
+	scanner sc = {{0}, 0, 0, 0, 0, 0};
+	fbuf values[SERIESMAX];
+	signed char pick[COLMAX];
+	double t=seconds();
+	printf("file: %s ", filename);
+	setup();
+	memset(pick, -1, sizeof(pick));
+	for(k=0;k<ctx->ncolumns;k++)
+	{
+		pick[ctx->columns[k]] = k;
+		values[k] = (fbuf){ctx->values[k], 0, ctx->values_cap[k], -1, 0};
+	}
+	fd = open_input(filename, 0);
+	unload(ctx);
+	ctx->stats.bytes += scan_file(fd, &sc, values, 1, pick);	// as graph_load, an
+															// unterminated last row is dropped
+	if(fd!=STDIN_FILENO) close(fd);
+	if(sc.errors)derror(sc.errors);
+	for(k=0;k<ctx->ncolumns;k++)
+	{
+		sizes[k] = values[k].spilled+values[k].size;
+		if(sizes[k]<=0) f_error(filename, "no values found in column");
+		bufs[k] = settle(ctx, &values[k], k);
+		total += sizes[k];
+	}
+	ctx->stats.load += seconds()-t;
+	ctx->stats.values += total;
+	ctx->stats.skipped += sc.errors;
+	printf("%d values found in %d columns.\n", total, ctx->ncolumns);
+	return ctx->ncolumns;
+}
+/************************************************************************************/
+/* frame buffer: a graph is drawn into one preallocated buffer and written to		*/
+/* stdout with a single write, instead of one printf per character					*/
+/************************************************************************************/
+/************************************************************************************/
+/* frame_reserve:	makes room for n more bytes in the frame						*/
+/************************************************************************************/
+static void frame_reserve(frame* f, size_t n)
+{
+	if(f->len+n<=f->cap) return;
+	f->cap = 2*(f->len+n);
+	f->data = (char*)realloc(f->data, f->cap);
+	if(!f->data) aerror();
+}
+#define PUT(f, c) ((f)->data[(f)->len++] = (c))	// room must be reserved first
+/************************************************************************************/
+/* frame_printf:	printf into the frame											*/
+/************************************************************************************/
+static void frame_printf(frame* f, const char* fmt, ...)
+{
+	va_list ap;
+	int n;
+	frame_reserve(f, 1);
+	va_start(ap, fmt);
+	n = vsnprintf(f->data+f->len, f->cap-f->len, fmt, ap);
+	va_end(ap);
+	if(n>=0 && (size_t)n>=f->cap-f->len)	// did not fit, grow and redo
+	{
+		frame_reserve(f, n+1);
+		va_start(ap, fmt);
+		vsnprintf(f->data+f->len, f->cap-f->len, fmt, ap);
+		va_end(ap);
+	}
+	if(n>0) f->len += n;
+}
+/************************************************************************************/
+/* frame_flush:	writes the frame to stdout, after anything printed before it		*/
+/************************************************************************************/
+static void frame_flush(frame* f)
+{
+	size_t done=0;
+	ssize_t n;
+	fflush(stdout);
+	for(;done<f->len;done+=n)
+		if((n=write(STDOUT_FILENO, f->data+done, f->len-done))<=0)
+			break;
+	f->len = 0;
+}
+/************************************************************************************/
+/* glyph_len:	returns the # of bytes of the UTF-8 character at p					*/
+/************************************************************************************/
+static int glyph_len(const char* p, const char* end)
+{
+	int n=1;
+	while(p+n<end && (p[n]&0xC0)==0x80) n++;
+	return n;
+}
+/************************************************************************************/
+/* frame_show:	puts the frame on the terminal, with cursor moves to only the		*/
+/*				characters that changed since the frame shown before. The screen	*/
+/*				is cleared and redrawn when the y-scale or the # of lines changes.	*/
+/*				Output that is not a terminal gets every frame whole, without codes	*/
+/* parameter: 	ctx - the context, its frame is shown and then emptied				*/
+/************************************************************************************/
+static void frame_show(graph_ctx* ctx)
+{
+	frame *f=&ctx->screen, *old=&ctx->shown, *d=&ctx->delta, swap;
+	const char *a=f->data, *b=old->data, *aend=a+f->len, *bend=b+old->len, *ae, *be;
+	int row=1, col, na, nb, run, lines=0, full=!old->len, plain=!isatty(STDOUT_FILENO);
+	for(ae=a;ae<aend;ae++) lines += *ae=='\n';
+	for(be=b;be<bend;be++) lines -= *be=='\n';
+	full |= plain || lines || ctx->maxval!=ctx->shown_max || ctx->minval!=ctx->shown_min;
+	d->len = 0;
+	if(full)
+	{
+		if(!plain) frame_printf(d, "\033[H\033[J");	// cursor home, clear screen
+		frame_reserve(d, f->len);
+		memcpy(d->data+d->len, f->data, f->len);
+		d->len += f->len;
+	}
+	else for(;a<aend;row++, a=ae+1, b=be+1)	// line by line, character by character
+	{
+		if(b>bend) b = bend;
+		ae = memchr(a, '\n', aend-a);
+		be = memchr(b, '\n', bend-b);
+		if(!ae) ae = aend;
+		if(!be) be = bend;
+		for(col=1, run=0; a<ae; col++, a+=na, b+=nb)
+		{
+			na = glyph_len(a, ae);
+			nb = b<be?glyph_len(b, be):0;
+			if(na==nb && !memcmp(a, b, na)) {run = 0; continue;}
+			if(!run) frame_printf(d, "\033[%d;%dH", row, col);
+			frame_reserve(d, na);
+			memcpy(d->data+d->len, a, na);
+			d->len += na;
+			run = 1;
+		}
+		if(b<be) frame_printf(d, "\033[%d;%dH\033[K", row, col);	// line got shorter
+		b = be;
+	}
+	if(!full) frame_printf(d, "\033[%d;1H", row);	// cursor below the graph
+	frame_flush(d);
+	swap = *old;							// keep the frame to diff the next one
+	*old = *f;
+	*f = swap;
+	f->len = 0;
+	ctx->shown_max = ctx->maxval;
+	ctx->shown_min = ctx->minval;
+}
+/************************************************************************************/
+/* print_xscale: 	draws the x-axis and scale of the graph							*/
+/* parameter: 		ctx - the context												*/
+/* parameter: 		xratio - the ratio between # of datapoints and graph width		*/
+/************************************************************************************/
+static void print_xscale(graph_ctx* ctx, float xratio)
+{
+	int i;
+	frame* f = &ctx->screen;
+	frame_printf(f, "%4c", ' ');			// padding before x-scale lines
+	frame_reserve(f, ctx->width);
+	for(i=0 ; i<ctx->width; i++)			// print x-scale lines
+		if(i%10==0)
+			PUT(f, '|');
+		else
+			PUT(f, ' ');
+	frame_printf(f, "\n%4c", ' ');			// padding before x-scale values
+		for(i=0 ; i<ctx->width; i++)		// print x-scale values
+			if(i%10==0)
+				frame_printf(f, "%-10.0f", i*xratio);
+	frame_printf(f, "\n");
+}
+/************************************************************************************/
+/* fixed_ratio:	returns the # of values per column as 32.32 fixed point, so that	*/
+/*				column bounds are exact however many values there are				*/
+/************************************************************************************/
+static uint64_t fixed_ratio(int size, int cols)
+{
+	return size>cols?((uint64_t)size<<32)/cols:(uint64_t)1<<32;
+}
+typedef struct								// columns compressed by one thread
+{
+	graph_ctx* ctx;
+	float* buf;
+	int size;
+	uint64_t ratio;							// values per column, see fixed_ratio
+	int from, to;							// the columns
+	float* copy;
+	float* low;
+	int m;									// # of columns within the values
+	float maxval, minval;					// y-scale of the slice
+	int threaded;							// 1 if the slice is run by a thread
+} slice;
+/************************************************************************************/
+/* compress_cols:	the column loop of compress_at for one compression scheme. It	*/
+/*					is inlined into a variant per scheme, so that the scheme is		*/
+/*					tested once rather than per column. Column c covers values		*/
+/*					floor(c*ratio) up to ceil((c+1)*ratio). Columns only depend on	*/
+/*					their own values, so slices of columns can be compressed apart	*/
+/* parameter: 		sl - the slice of columns, and where its y-scale goes			*/
+/* parameter: 		mode - 1 average, 2 select or 3 min/max, a constant				*/
+/************************************************************************************/
+static inline __attribute__((always_inline))
+void compress_cols(slice* sl, const int mode)
+{
+	float *buf=sl->buf, *copy=sl->copy, *low=sl->low;
+	float last=0, xratio=sl->ratio/4294967296.0, maxval=-FLT_MAX, minval=FLT_MAX;
+	int c, from, to, done, size=sl->size;
+	uint64_t pos=sl->from*sl->ratio, ratio=sl->ratio;
+	span col;
+	done = pos>>32;
+	if(mode==3 && sl->from>0 && done<size)	// the previous column ends where this begins
+		last = buf[((pos+0xFFFFFFFF)>>32)-1];
+	for(c=sl->from; c<sl->to && (int)(pos>>32)<size; c++, pos+=ratio)
+	{
+		from = pos>>32;
+		to = (pos+ratio+0xFFFFFFFF)>>32;
+		if(to>size) to = size;
+		query(&sl->ctx->index_map, buf, from, to, &col);
+		if(col.max>maxval) maxval = col.max;
+		if(col.min<minval) minval = col.min;
+		if(mode==3)							// min, max, first and last (M4)
+		{
+			copy[c] = c&&last>col.max?last:col.max;
+			low[c] = c&&last<col.min?last:col.min;
+			last = buf[to-1];
+		}
+		else if(mode==1)					// average
+			copy[c] = col.sum/xratio;
+		else								// selection
+			copy[c] = buf[from];
+		if(to-done>=CHUNK)					// stream over the buffer a chunk at a time
+		{
+			release(sl->ctx, buf, done, to-1);
+			done = to-1;
+		}
+	}
+	sl->m = c-sl->from;
+	sl->maxval = maxval;
+	sl->minval = minval;
+}
+/************************************************************************************/
+/* compress_slice:	runs compress_cols with the scheme of the context				*/
+/************************************************************************************/
+static void* compress_slice(void* arg)
+{
+	slice* sl = (slice*)arg;
+	switch(sl->ctx->compression)			// the scheme picks the variant, once
+	{
+		case 1: compress_cols(sl, 1); break;
+		case 3: compress_cols(sl, 3); break;
+		default: compress_cols(sl, 2); break;
+	}
+	return NULL;
+}
+/************************************************************************************/
+/* compress_quantiles:	the column loop of compress_at for quantiles, see			*/
+/*						compress_cols												*/
+/************************************************************************************/
+static int compress_quantiles(graph_ctx* ctx, float* buf, int size, uint64_t ratio, int cols, float* copy, float* low, float* high)
+{
+	static const float Q[3] = {0.5, 0.95, 0.99};
+	float qs[3];
+	int m, from, to, j, done=0;
+	uint64_t pos;
+	kll* sk = (kll*)arena_alloc(&ctx->scratch, 2*sizeof(kll));
+	kll* all = sk+1;
+	weighted* sorted = (weighted*)arena_alloc(&ctx->scratch, KLLLEVELS*2*KLLK*sizeof(weighted));
+	kll_clear(all, 2017);
+	for(m=0, pos=0; m<cols && (int)(pos>>32)<size; m++, pos+=ratio)
+	{
+		from = pos>>32;
+		to = (pos+ratio+0xFFFFFFFF)>>32;
+		if(to>size) to = size;
+		kll_clear(sk, 2017+m*2654435761u);	// p50, p95 and p99 of the column
+		for(j=from;j<to;j++)
+			kll_add(sk, 0, buf[j]);
+		kll_quantiles(sk, Q, 3, qs, sorted);
+		kll_merge(all, sk);
+		copy[m] = qs[0];
+		low[m] = qs[1];
+		if(high) high[m] = qs[2];
+		if(qs[0]<ctx->minval) ctx->minval = qs[0];
+		if(qs[high?2:1]>ctx->maxval) ctx->maxval = qs[high?2:1];
+		if(to-done>=CHUNK)
+		{
+			release(ctx, buf, done, to-1);
+			done = to-1;
+		}
+	}
+	kll_quantiles(all, Q, 3, ctx->quantiles, sorted);
+	return m;
+}
+/************************************************************************************/
+/* compress_at:	compresses buf to at most cols columns of ratio values each, see	*/
+/*				compress. For quantiles (4), copy holds the median, low p95 and		*/
+/*				high p99 of each column, and the y-scale spans them					*/
+/* parameter: 	ratio - values per column, see fixed_ratio							*/
+/* returns: 	# of columns														*/
+/************************************************************************************/
+static int compress_at(graph_ctx* ctx, float* buf, int size, uint64_t ratio, int cols, float* copy, float* low, float* high)
+{
+	slice sl[SLICEMAX];
+	pthread_t tid[SLICEMAX];
+	int m=0, n, k;
+	double t=seconds();
+	setup();
+	ctx->maxval = -FLT_MAX;
+	ctx->minval = FLT_MAX;
+	if(ctx->compression==4)
+		m = compress_quantiles(ctx, buf, size, ratio, cols, copy, low, high);
+	else
+	{
+		n = size/SLICEMIN;					// # of slices, each on a thread of its own
+		if(n>ctx->threads) n = ctx->threads;
+		if(n>cols) n = cols;
+		if(n>SLICEMAX) n = SLICEMAX;
+		if(n<1) n = 1;
+		for(k=0;k<n;k++)
+		{
+			sl[k] = (slice){ctx, buf, size, ratio, (int)((long long)cols*k/n), (int)((long long)cols*(k+1)/n), copy, low};
+			sl[k].threaded = k<n-1 && !pthread_create(&tid[k], NULL, compress_slice, &sl[k]);
+		}
+		for(k=0;k<n;k++)					// the last slice, and any left over, run here
+			if(!sl[k].threaded) compress_slice(&sl[k]);
+		for(k=0;k<n;k++)					// min and max are the same in any order
+		{
+			if(sl[k].threaded) pthread_join(tid[k], NULL);
+			m += sl[k].m;
+			if(sl[k].maxval>ctx->maxval) ctx->maxval = sl[k].maxval;
+			if(sl[k].minval<ctx->minval) ctx->minval = sl[k].minval;
+		}
+	}
+	if(DEBUG)print_data(copy, m);
+	ctx->stats.compress += seconds()-t;
+	return m;
+}
+/************************************************************************************/
+/* compress_values:	compresses buf to one value per column and finds the y-scale,	*/
+/*				maxval and minval, in a single sweep over buf						*/
+/* parameters: 	ctx				the context											*/
+/* parameters: 	buf, size		the values											*/
+/* parameters: 	copy			output buffer, one value per column					*/
+/* parameters: 	low				output buffer for the bottom of min/max spans		*/
+/*				columns hold averages (compression 1), selected values (2),			*/
+/*				min/max spans (3) or medians, with p95 in low (4). A span also		*/
+/*				reaches the last value of the previous column, so that spikes and	*/
+/*				steps stay connected												*/
+/* returns: 	ratio between # of data points in file and # of columns				*/
+/*				kept for graphbench, which includes this file						*/
+/************************************************************************************/
+__attribute__((unused))
+static float compress_values(graph_ctx* ctx, float* buf, int size, float* copy, float* low)
+{
+	float xratio=1;
+	if(size>ctx->width)					// more data points than positions on x-axis?
+		xratio = (float)size / (float)ctx->width;
+	if(DEBUG)
+		printf("buf_size=%d, des_size=%d, ratio=%f\n", size, ctx->width, xratio);
+	arena_reset(&ctx->scratch);
+	compress_at(ctx, buf, size, fixed_ratio(size, ctx->width), ctx->width, copy, low, NULL);
+	return xratio;
+}
+/************************************************************************************/
+/* print_ylabel:	draws the y-axis of row k, with the origin or a label on it		*/
+/* parameter: 		f - the frame													*/
+/* parameter: 		maxval, step - value of the top row and between rows			*/
+/* parameter: 		k - the row														*/
+/* parameter: 		origotime - 1 until the origin has been drawn					*/
+/* returns: 		1 if the row holds the origin									*/
+/************************************************************************************/
+static int print_ylabel(frame* f, float maxval, float step, int k, int origotime)
+{
+	int kflag=0, mflag=0;
+	kflag=fabs(maxval-step*k)>KILO?1:0;					// large number (>1000)
+	mflag=fabs(maxval-step*k)>MEGA?1:0;					// larger number (>1000000)
+	// ------------------------------------------------Y-axis drawing, 3 cases:
+	if(origotime&&(maxval-step*k)<=0)				// case 1: origo, i.e. draw '0'
+		{frame_printf(f, "%3d_|", 0); return 1;}		// and a line		
+	else if((k%5==0)&&(fabs(maxval-step*k)>0.5)) 	// case 2: draw label + line
+		frame_printf(f, "%3.0f%c|", round(mflag?(maxval-step*k)/MEGA: 
+							kflag?(maxval-step*k)/KILO:	maxval-step*k), 
+							mflag?'M': kflag?'k': ' ');
+	else frame_printf(f, "%5c", '|');					// case 3: draw just the line
+	return 0;
+}
+/************************************************************************************/
+/* first_row:	finds the top row of the graph that value v reaches, the first row k*/
+/*				with v >= maxval-step*k. The row is guessed from the y-scale and	*/
+/*				then moved to where the per-row compare would have put it			*/
+/* returns: 	the row, or height+1 if v is below the graph						*/
+/************************************************************************************/
+static int first_row(float v, float maxval, float step, int height)
+{
+	float guess;
+	int k;
+	if(!(v>=maxval-step*height)) return height+1;		// below the graph, or not a number
+	guess = step>0?ceilf((maxval-v)/step):0;
+	k = guess<0?0:guess>height?height:guess;
+	while(k>0 && v>=maxval-step*(k-1)) k--;
+	while(v<maxval-step*k) k++;
+	return k;
+}
+/************************************************************************************/
+/* plot_rows:	writes the rows of a plotted grid to the frame, with the y-axis and	*/
+/*				the end of the X-axis. Inlined into an ASCII variant, where a row	*/
+/*				is copied whole, and a UTF-8 variant expanding the \1 points		*/
+/* parameter: 	grid - rows*cols characters, see plot								*/
+/* parameter: 	axis - the row the X-axis is drawn on, -1 if none					*/
+/* parameter: 	utf8 - 1 if the first series is drawn with ctx->unistyle, a constant*/
+/************************************************************************************/
+static inline __attribute__((always_inline))
+void plot_rows(graph_ctx* ctx, const char* grid, int rows, int cols, int size, float maxval, float step, int axis, const int utf8)
+{
+	frame* f = &ctx->screen;
+	const char* row;
+	char* u;
+	int i, k, run, ulen=strlen(ctx->unistyle);
+	frame_printf(f, "%4c\n",'Y');
+	for(k=0;k<rows;k++)
+	{
+		print_ylabel(f, maxval, step, k, axis<0 || k<=axis);
+		row = grid+(size_t)k*cols;
+		frame_reserve(f, (utf8?ulen:1)*cols+ctx->width+32);	// room for the row and X-axis
+		if(!utf8)
+		{
+			memcpy(f->data+f->len, row, cols);
+			f->len += cols;
+		}
+		else for(i=0;i<cols;)
+		{
+			run = (u=(char*)memchr(row+i, '\1', cols-i))?u-(row+i):cols-i;
+			memcpy(f->data+f->len, row+i, run);		// up to the next point
+			f->len += run;
+			for(i+=run;i<cols && row[i]=='\1';i++, f->len+=ulen)
+				memcpy(f->data+f->len, ctx->unistyle, ulen);
+		}
+		if(k==axis)										// rest of X-axis
+		{
+			for(i=cols;i<ctx->width;i++)
+				PUT(f, '_');
+			frame_printf(f, "X (%d)", size<ctx->width?ctx->width:size);
+		}
+		PUT(f, '\n');
+	}
+}
+/************************************************************************************/
+/* plot: 		draws the graph of compressed values, scaled by maxval and minval	*/
+/* parameter: 	ctx - the context, the graph is drawn into its frame				*/
+/* parameter: 	copy - the compressed values of each series, one per column			*/
+/* parameter: 	low - bottoms of the column spans, NULL unless compression is 3		*/
+/* parameter: 	n - # of series, where several hit a cell the first one is drawn	*/
+/* parameter: 	size - # of values the columns represent							*/
+/* parameter: 	xratio - # of values per column										*/
+/*				the x-scale is drawn by the caller									*/
+/************************************************************************************/
+static void plot(graph_ctx* ctx, float **copy, float **low, int n, int size, float xratio)
+{
+	int i, k, s, top, bottom, axis=-1, rows=ctx->height+1, cols=size<ctx->width?size:ctx->width;
+	float step=1.0, maxval=ctx->maxval, minval=ctx->minval;
+	char *grid, glyph;
+														// compute y-ratio
+	step = ((maxval>0?maxval:0)-(minval>0?0:minval))/(float)ctx->height;
+	step = (maxval-(minval>0?0:minval))/(float)ctx->height;
+	for(k=0;k<rows && axis<0;k++)						// the row the X-axis is drawn on
+		if((maxval-step*(k))<=0) axis = k;
+	grid = (char*)arena_alloc(&ctx->scratch, (size_t)rows*cols+1);
+	for(k=0;k<rows;k++)
+		memset(grid+(size_t)k*cols, k==axis?'_':' ', cols);
+	for(s=n-1; s>=0; s--)								// the first series is set last, and wins
+	{
+		glyph = s==0 && ctx->unistyle[0]?'\1':ctx->styles[s];	// \1 stands for the UTF-8 point
+		for(i=0; i<cols; i++)
+		{
+			top = first_row(copy[s][i], maxval, step, ctx->height);
+			bottom = low?first_row(low[s][i], maxval, step, ctx->height):top;
+			for(k=top; k<=bottom && k<rows; k++)
+				grid[(size_t)k*cols+i] = glyph;
+		}
+	}
+	if(ctx->unistyle[0])								// the variant is picked once
+		plot_rows(ctx, grid, rows, cols, size, maxval, step, axis, 1);
+	else
+		plot_rows(ctx, grid, rows, cols, size, maxval, step, axis, 0);
+	if(DEBUG)printf("maxval=%f, ctx->width=%d, ctx->height=%d, step=%f, xratio=%f\n", maxval, ctx->width, ctx->height, step, xratio);
+}
+/************************************************************************************/
+/* plot_bands:	draws the median of each column with the series style, shades the	*/
+/*				rows up to p95 dark and the rows up to p99 light					*/
+/* parameter: 	ctx - the context, the graph is drawn into its frame				*/
+/* parameter: 	copy, low, high - p50, p95 and p99 of each column of each series	*/
+/* parameter: 	n, size, xratio - as for plot										*/
+/************************************************************************************/
+static void plot_bands(graph_ctx* ctx, float **copy, float **low, float **high, int n, int size, float xratio)
+{
+	int i, k, m, s, hit, origotime=1;
+	float step, bottom, above=INFINITY, maxval=ctx->maxval, minval=ctx->minval;
+	frame* f = &ctx->screen;
+	char* u;
+	step = (maxval-(minval>0?0:minval))/(float)ctx->height;
+	frame_printf(f, "%4c\n",'Y');
+	for(k=0;k<=ctx->height;k++)
+	{
+		bottom = maxval-step*k;
+		print_ylabel(f, maxval, step, k, origotime);
+		frame_reserve(f, 4*ctx->width+1);				// room for the row, in UTF-8
+		for(i=0 ; i<ctx->width&&i<size; i++)
+		{
+			for(hit=0, s=0; s<n && !hit; s++)			// the first series in the row wins
+				if(copy[s][i]>=bottom && copy[s][i]<above) hit = s+1;	// median
+				else if(low[s][i]>=bottom && copy[s][i]<above) hit = -1;	// up to p95
+				else if(high[s][i]>=bottom && copy[s][i]<above) hit = -2;	// up to p99
+			if(hit==1 && ctx->unistyle[0])
+				for(u=ctx->unistyle;*u;u++) PUT(f, *u);
+			else if(hit>0) PUT(f, ctx->styles[hit-1]);
+			else if(hit)								// U+2592 or U+2591 shade
+			{
+				PUT(f, 0xE2);
+				PUT(f, 0x96);
+				PUT(f, hit==-1?0x92:0x91);
+			}
+			else if(origotime&&bottom<=0) PUT(f, '_');	// X-axis drawing
+			else PUT(f, ' ');
+		}
+		if(origotime&&bottom<=0)						// rest of X-axis
+		{
+			for(m=i;m<ctx->width;m++)
+				PUT(f, '_');
+			frame_printf(f, "X (%d)", size<ctx->width?ctx->width:size);
+			origotime=0;
+		}
+		PUT(f, '\n');
+		above = bottom;									// top of next row
+	}
+	if(DEBUG)printf("maxval=%f, ctx->width=%d, ctx->height=%d, step=%f, xratio=%f\n", maxval, ctx->width, ctx->height, step, xratio);
+}
+/************************************************************************************/
+/* plot_cells:	draws the graph with 2 columns and ctx->cells rows of points per	*/
+/*				character, braille patterns for 4 rows and quadrant blocks for 2.	*/
+/*				The points are set in a bitmap of one mask per character, which		*/
+/*				is then turned into UTF-8 a row at a time							*/
+/* parameter: 	ctx - the context, the graph is drawn into its frame				*/
+/* parameter: 	copy, low, n, size - as for plot, with two columns per character	*/
+/* parameter: 	xratio - # of values per character									*/
+/*				the x-scale is drawn by the caller									*/
+/************************************************************************************/
+static void plot_cells(graph_ctx* ctx, float **copy, float **low, int n, int size, float xratio)
+{
+	static const unsigned char braille[2][4] = {{0x01, 0x02, 0x04, 0x40}, {0x08, 0x10, 0x20, 0x80}};
+	static const unsigned char quadrant[2][2] = {{1, 4}, {2, 8}};
+	static const int blocks[16] = {' ', 0x2598, 0x259D, 0x2580, 0x2596, 0x258C, 0x259E, 0x259B,
+		0x2597, 0x259A, 0x2590, 0x259C, 0x2584, 0x2599, 0x259F, 0x2588};
+	int i, k, m, s, g, top, bottom, origo, origotime=1;
+	int sub = ctx->cells, rows = sub*(ctx->height+1), cols = 2*ctx->width;
+	float step=1.0, maxval=ctx->maxval, minval=ctx->minval, y, ylow;
+	frame* f = &ctx->screen;
+	unsigned char* bits = (unsigned char*)arena_alloc(&ctx->scratch, (ctx->height+1)*ctx->width);
+	step = (maxval-(minval>0?0:minval))/(float)ctx->height;
+	memset(bits, 0, (ctx->height+1)*ctx->width);
+	for(s=0; s<n; s++)									// set the points
+		for(i=0; i<cols && i<size; i++)
+		{
+			y = step>0?sub*(maxval-copy[s][i])/step:0;	// points below the top
+			ylow = low&&step>0?sub*(maxval-low[s][i])/step:y;
+			if(!isfinite(y) || !isfinite(ylow)) continue;	// past the end, or not a number
+			top = sub-1+ceilf(y);
+			bottom = sub-1+ceilf(ylow);
+			if(top<0) top = 0;
+			if(bottom>=rows) bottom = rows-1;
+			for(g=top; g<=bottom; g++)
+				bits[g/sub*ctx->width+i/2] |= sub==4?braille[i&1][g%4]:quadrant[i&1][g%2];
+		}
+	frame_printf(f, "%4c\n",'Y');
+	for(k=0;k<=ctx->height;k++)
+	{
+		origo = print_ylabel(f, maxval, step, k, origotime);
+		frame_reserve(f, 3*ctx->width+1);				// room for the row, in UTF-8
+		for(i=0 ; i<ctx->width && 2*i<size; i++)
+		{
+			m = bits[k*ctx->width+i];
+			if(!m) PUT(f, origo?'_':' ');				// X-axis drawing, or nothing
+			else
+			{
+				g = sub==4?0x2800+m:blocks[m];			// 3 byte UTF-8
+				PUT(f, 0xE0|(g>>12));
+				PUT(f, 0x80|((g>>6)&0x3F));
+				PUT(f, 0x80|(g&0x3F));
+			}
+		}
+		if(origo)										// rest of X-axis
+		{
+			for(m=i;m<ctx->width;m++)
+				PUT(f, '_');
+			frame_printf(f, "X (%d)", size<cols?cols:size);
+			origotime=0;
+		}
+		PUT(f, '\n');
+	}
+}
+/************************************************************************************/
+/* histogram:	draws the distribution of a series as one horizontal bar per bin,	*/
+/*				height+1 bins of equal width from the smallest value to the			*/
+/*				largest. The range comes from the reduce kernel, or the index, and	*/
+/*				the counts from a single pass over the values, a chunk at a time	*/
+/* parameter: 	ctx - the context, the histogram is drawn into its frame			*/
+/* parameter: 	buf, size - the values												*/
+/* parameter: 	s - the series, for its style										*/
+/************************************************************************************/
+static void histogram(graph_ctx* ctx, float* buf, int size, int s)
+{
+	int bins=ctx->height+1, i, j, k, bar, done=0, skipped=0;
+	long long* count = (long long*)arena_alloc(&ctx->scratch, bins*sizeof(long long));
+	long long most=0;
+	double lo, width, scale;
+	frame* f = &ctx->screen;
+	span all, part;
+	char* u;
+	if(size<=0) return;						// nothing found, already reported
+	all.min = INFINITY;
+	all.max = -INFINITY;
+	for(i=0;i<size;i+=CHUNK)				// the range, a chunk at a time
+	{
+		query(&ctx->index_map, buf, i, size-i<CHUNK?size:i+CHUNK, &part);
+		if(!isfinite(part.sum))				// NaN or inf in raw input, the finite ones
+			for(j=i, part.min=INFINITY, part.max=-INFINITY;j<size && j<i+CHUNK;j++)
+			{
+				if(!isfinite(buf[j])) continue;
+				if(buf[j]<part.min) part.min = buf[j];
+				if(buf[j]>part.max) part.max = buf[j];
+			}
+		if(part.min<all.min) all.min = part.min;
+		if(part.max>all.max) all.max = part.max;
+		release(ctx, buf, i, size-i<CHUNK?size:i+CHUNK);
+	}
+	if(all.min>all.max) return;				// no finite values
+	lo = all.min;
+	width = ((double)all.max-lo)/bins;
+	scale = all.max>all.min?bins/((double)all.max-lo):0;
+	memset(count, 0, bins*sizeof(long long));
+	for(i=0;i<size;i++)
+	{
+		if(!isfinite(buf[i])) {skipped++; continue;}
+		k = (buf[i]-lo)*scale;
+		count[k<0?0:k<bins?k:bins-1]++;		// the largest value closes the last bin
+		if(i-done>=CHUNK)					// stream over the buffer a chunk at a time
+		{
+			release(ctx, buf, done, i);
+			done = i;
+		}
+	}
+	for(k=0;k<bins;k++)
+		if(count[k]>most) most = count[k];
+	for(k=0;k<bins;k++)
+	{
+		frame_printf(f, "%10.4g |", lo+width*k);
+		bar = most?(count[k]*ctx->width+most-1)/most:0;	// any count shows
+		frame_reserve(f, 4*bar+1);
+		for(i=0;i<bar;i++)
+			if(s==0 && ctx->unistyle[0])
+				for(u=ctx->unistyle;*u;u++) PUT(f, *u);
+			else PUT(f, ctx->styles[s]);
+		frame_printf(f, " %lld\n", count[k]);
+	}
+	frame_printf(f, "%10.4g  %d values in %d bins of %g", all.max, size-skipped, bins, width);
+	frame_printf(f, skipped?", %d not finite skipped\n":"\n", skipped);
+}
+/************************************************************************************/
+/* _graph_series:	draws several series on a shared axis, scaled to the longest	*/
+/* parameter: 		ctx - the context, the graph is drawn into its frame			*/
+/* parameter: 		bufs, sizes - the values and size of each series				*/
+/* parameter: 		n - # of series													*/
+/************************************************************************************/
+static void _graph_series(graph_ctx* ctx, float **bufs, int* sizes, int n)
+{
+	float xratio=1, maxval=-FLT_MAX, minval=FLT_MAX;
+	float *copy[SERIESMAX], *low[SERIESMAX], *high[SERIESMAX];
+	float q[SERIESMAX][3];
+	int k, m, size=0, cols, width=ctx->cells?2*ctx->width:ctx->width;
+	size_t len=ctx->screen.len;
+	float *mem;
+	double t;
+	for(k=0;k<n;k++)
+		if(sizes[k]>size) size = sizes[k];
+	if(size<=0) return;									// nothing found, already reported
+	cols = size>width?width:size;
+	arena_reset(&ctx->scratch);							// a new render
+	if(ctx->histogram)									// distributions instead
+	{
+		t = seconds();
+		for(k=0;k<n;k++)
+			histogram(ctx, bufs[k], sizes[k], k);
+		ctx->stats.render += seconds()-t;
+		ctx->stats.output += ctx->screen.len-len;
+		return;
+	}
+	mem = (float*)arena_alloc(&ctx->scratch, 3*n*cols*sizeof(float));	// values, span bottoms and p99s
+	if(size>width)
+		xratio = (float)size / (float)width;
+	for(k=0;k<n;k++)
+	{
+		copy[k] = mem+3*k*cols;
+		low[k] = copy[k]+cols;
+		high[k] = low[k]+cols;
+		m = compress_at(ctx, bufs[k], sizes[k], fixed_ratio(size, width), cols, copy[k], low[k], high[k]);
+		for(;m<cols;m++)								// a shorter series ends early
+			copy[k][m] = low[k][m] = high[k][m] = -INFINITY;
+		if(ctx->maxval>maxval) maxval = ctx->maxval;
+		if(ctx->minval<minval) minval = ctx->minval;
+		memcpy(q[k], ctx->quantiles, sizeof(q[k]));
+	}
+	ctx->maxval = maxval;
+	ctx->minval = minval;
+	t = seconds();
+	if(ctx->compression==4)								// quantiles of all the values
+		for(k=0;k<n;k++)
+			frame_printf(&ctx->screen, "%4c p50 %g  p95 %g  p99 %g\n", ctx->styles[k], q[k][0], q[k][1], q[k][2]);
+	if(ctx->cells)
+		plot_cells(ctx, copy, ctx->compression==3?low:NULL, n, size, 2*xratio);
+	else if(ctx->compression==4)
+		plot_bands(ctx, copy, low, high, n, size, xratio);
+	else
+		plot(ctx, copy, ctx->compression==3?low:NULL, n, size, xratio);
+	print_xscale(ctx, ctx->cells?2*xratio:xratio);		// Draw the X-scale
+	ctx->stats.render += seconds()-t;
+	ctx->stats.output += ctx->screen.len-len;
+}
+/************************************************************************************/
+/* _graph: 		draws a graph of data values in buf of size size					*/
+/* parameter: 	ctx - the context, the graph is drawn into its frame				*/
+/* parameter: 	buf - the buffer containing values									*/
+/* parameter: 	size - the buffer size												*/
+/************************************************************************************/
+static void _graph(graph_ctx* ctx, float *buf, int size)
+{
+	_graph_series(ctx, &buf, &size, 1);
+}
+/************************************************************************************/
+/* graph: 		draws a graph of data values in buf of size size					*/
+/* parameter: 	buf - the buffer containing values									*/
+/* parameter: 	size - the buffer size												*/
+/*				calls _graph for actual work										*/
+/************************************************************************************/
+void graph(float *buf, int size)
+{
+	printf("graph \u14B7 Copyright (C) 2017 Martin Blom\n");
+	_graph(&deflt, buf, size);
+	frame_flush(&deflt.screen);
+}
+/************************************************************************************/
+/* graph_columns:	draws several series on a shared axis, see _graph_series		*/
+/************************************************************************************/
+void graph_columns(float **bufs, int* sizes, int n)
+{
+	printf("graph \u14B7 Copyright (C) 2017 Martin Blom\n");
+	_graph_series(&deflt, bufs, sizes, n);
+	frame_flush(&deflt.screen);
+}
+/************************************************************************************/
+/* graph_render:	draws a graph of data values into a caller buffer, as snprintf	*/
+/* parameter: 		ctx - the context												*/
+/* parameter: 		buf, size - the values											*/
+/* parameter: 		out, cap - the buffer and its size								*/
+/* returns: 		length of the graph, which is cut short if it is cap or more	*/
+/************************************************************************************/
+int graph_render(graph_ctx* ctx, float *buf, int size, char* out, int cap)
+{
+	int len;
+	_graph(ctx, buf, size);
+	len = ctx->screen.len;
+	if(cap>0)
+	{
+		memcpy(out, ctx->screen.data, len<cap?len:cap-1);
+		out[len<cap?len:cap-1] = '\0';
+	}
+	ctx->screen.len = 0;
+	return len;
+}
+/************************************************************************************/
+/* graph_print:	draws a graph of data values to a stream							*/
+/* parameter: 	ctx - the context													*/
+/* parameter: 	buf, size - the values												*/
+/* parameter: 	out - the stream													*/
+/************************************************************************************/
+void graph_print(graph_ctx* ctx, float *buf, int size, FILE* out)
+{
+	graph_print_columns(ctx, &buf, &size, 1, out);
+}
+/************************************************************************************/
+/* graph_print_columns:	draws several series on a shared axis to a stream			*/
+/************************************************************************************/
+void graph_print_columns(graph_ctx* ctx, float **bufs, int* sizes, int n, FILE* out)
+{
+	_graph_series(ctx, bufs, sizes, n);
+	fwrite(ctx->screen.data, 1, ctx->screen.len, out);
+	ctx->screen.len = 0;
+}
+/************************************************************************************/
+/* streaming: values are taken as they arrive and kept in a ring of column buckets	*/
+/* covering the last window values, so memory stays bounded however long it runs	*/
+/************************************************************************************/
+typedef struct								// aggregate of the values of one column
+{
+	float sum, min, max, first, last;
+	int count;
+} bucket;
+typedef struct								// ring of buckets, one per column
+{
+	bucket* col;
+	int slots;								// # of buckets in the ring
+	int per;								// # of values per bucket
+	int head;								// bucket receiving new values
+	int used;								// # of buckets in use
+	int size;								// # of values in the window
+	float hi, lo;							// maximum and minimum in the window
+	int rescan;								// 1 if hi or lo left with an old bucket
+} ring;
+/************************************************************************************/
+/* msec:		returns a monotonic time stamp in milliseconds						*/
+/************************************************************************************/
+static long msec()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1000L + ts.tv_nsec/1000000L;
+}
+/************************************************************************************/
+/* ring_add:	adds a value to the newest bucket, evicting the oldest bucket when	*/
+/*				the newest is full and the ring has wrapped							*/
+/* parameter: 	r - the ring														*/
+/* parameter: 	val - the value														*/
+/************************************************************************************/
+static void ring_add(ring* r, float val)
+{
+	bucket* b = &r->col[r->head];
+	if(!r->used) r->used = 1;
+	else if(b->count>=r->per)				// newest bucket full, move on
+	{
+		r->head = (r->head+1)%r->slots;
+		b = &r->col[r->head];
+		if(r->used==r->slots)				// ring full, evict the oldest bucket
+		{
+			r->size -= b->count;
+			if(b->max>=r->hi || b->min<=r->lo) r->rescan = 1;
+		}
+		else r->used++;
+		b->count = 0;
+	}
+	if(!b->count){b->sum = 0; b->min = b->max = b->first = val;}
+	b->sum += val;
+	b->last = val;
+	if(val<b->min) b->min = val;
+	if(val>b->max) b->max = val;
+	b->count++;
+	if(!r->size++) r->hi = r->lo = val;
+	if(val>r->hi) r->hi = val;
+	if(val<r->lo) r->lo = val;
+}
+/************************************************************************************/
+/* ring_plot:	draws the graph of the values in the ring							*/
+/* parameter: 	ctx - the context													*/
+/* parameter: 	r - the ring														*/
+/* parameter: 	copy - buffer for two values per column								*/
+/*				only an evicted extreme forces a rescan, and then of the buckets	*/
+/************************************************************************************/
+static void ring_plot(graph_ctx* ctx, ring* r, float* copy)
+{
+	int i;
+	bucket *b, *prev=NULL;
+	float* low = copy+r->slots;
+	arena_reset(&ctx->scratch);
+	if(r->rescan)
+	{
+		r->hi = -FLT_MAX;
+		r->lo = FLT_MAX;
+		for(i=0;i<r->used;i++)
+		{
+			if(r->col[i].max>r->hi) r->hi = r->col[i].max;
+			if(r->col[i].min<r->lo) r->lo = r->col[i].min;
+		}
+		r->rescan = 0;
+	}
+	for(i=0;i<r->used;i++)					// oldest bucket first
+	{
+		b = &r->col[(r->head-r->used+1+i+r->slots)%r->slots];
+		copy[i] = ctx->compression==1?b->sum/b->count:b->first;
+		if(ctx->compression==3)					// span joined to the previous column
+		{
+			copy[i] = prev&&prev->last>b->max?prev->last:b->max;
+			low[i] = prev&&prev->last<b->min?prev->last:b->min;
+		}
+		prev = b;
+	}
+	ctx->maxval = r->hi;
+	ctx->minval = r->lo;
+	plot(ctx, &copy, ctx->compression==3?&low:NULL, 1, r->used, r->per);
+	print_xscale(ctx, r->per);
+}
+/************************************************************************************/
+/* stream_frame:	draws the current window, see frame_show						*/
+/************************************************************************************/
+static void stream_frame(graph_ctx* ctx, char* filename, ring* r, float* copy)
+{
+	double t = seconds();
+	frame_printf(&ctx->screen, "graph \u14B7 Copyright (C) 2017 Martin Blom\n");
+	frame_printf(&ctx->screen, "file: %s %d values in window\n", filename, r->size);
+	ring_plot(ctx, r, copy);
+	ctx->stats.output += ctx->screen.len;
+	frame_show(ctx);
+	ctx->stats.render += seconds()-t;
+}
+/************************************************************************************/
+/* graph_stream:	draws a rolling graph of values as they are read from a file	*/
+/* parameter: 	ctx - the context													*/
+/* parameter: 	filename - name of file containing values, "-" for stdin			*/
+/* parameter: 	follow - 1 to wait for more data at end of file, as tail -f does	*/
+/*				the graph is redrawn at most once every refresh ms					*/
+/************************************************************************************/
+void graph_stream(graph_ctx* ctx, char* filename, int follow)
+{
+	int fd, i, window, dirty=0;
+	long last=0;
+	double t;
+	ssize_t n;
+	char chunk[65536];
+	scanner sc = {{0}, 0, 0, 0};
+	fbuf values = {NULL, 0, 0, -1, 0};
+	struct pollfd pfd;
+	struct stat st;
+	ring r = {NULL, 0, 1, 0, 0, 0, 0, 0, 0};
+	float* copy;
+	fd = open_input(filename, 0);
+	setup();
+	window = ctx->window>0?ctx->window:ctx->width;
+	r.per = (window+ctx->width-1)/ctx->width;
+	r.slots = (window+r.per-1)/r.per;
+	r.col = (bucket*)calloc(r.slots, sizeof(bucket));
+	copy = (float*)malloc(2*r.slots*sizeof(float));
+	if(!r.col || !copy) aerror();
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	for(;;)
+	{
+		n = -1;								// -1: nothing read, 0: end of file
+		if(poll(&pfd, 1, ctx->refresh)>0)
+			n = read(fd, chunk, sizeof(chunk));
+		if(n>0)
+		{
+			t = seconds();
+			scan(&sc, chunk, chunk+n, &values);
+			for(i=0;i<values.size;i++)
+				ring_add(&r, values.data[i]);
+			dirty |= values.size>0;
+			ctx->stats.load += seconds()-t;
+			ctx->stats.bytes += n;
+			ctx->stats.values += values.size;
+			values.size = 0;
+		}
+		else if(n==0)
+		{
+			if(!follow) break;
+			if(fstat(fd, &st)==0 && S_ISREG(st.st_mode) && st.st_size<lseek(fd, 0, SEEK_CUR))
+				lseek(fd, 0, SEEK_SET);		// file was truncated, start over
+			usleep(ctx->refresh*1000);			// wait for the file to grow
+		}
+		if(dirty && msec()-last>=ctx->refresh)
+		{
+			stream_frame(ctx, filename, &r, copy);
+			last = msec();
+			dirty = 0;
+		}
+	}
+	if(dirty) stream_frame(ctx, filename, &r, copy);
+	ctx->stats.skipped += sc.errors;
+	if(fd!=STDIN_FILENO) close(fd);
+	free(values.data);
+	free(copy);
+	free(r.col);
+}
+/************************************************************************************/
+/* graph_watch:	graphs a file again each time it is rewritten, checking every		*/
+/*				refresh ms. Only the characters that changed are redrawn			*/
+/* parameter: 	ctx - the context													*/
+/* parameter: 	filename - name of file containing values							*/
+/************************************************************************************/
+void graph_watch(graph_ctx* ctx, char* filename)
+{
+	struct stat st, seen;
+	int size=0, errors=0;
+	float* buf;
+	memset(&seen, 0, sizeof(seen));
+	for(;;usleep(ctx->refresh*1000))
+	{
+		if(stat(filename, &st)) memset(&st, 0, sizeof(st));
+		if(st.st_size==seen.st_size && st.st_mtim.tv_sec==seen.st_mtim.tv_sec
+			&& st.st_mtim.tv_nsec==seen.st_mtim.tv_nsec && st.st_ino==seen.st_ino && ctx->shown.len)
+			continue;
+		seen = st;
+		frame_printf(&ctx->screen, "graph \u14B7 Copyright (C) 2017 Martin Blom\n");
+		buf = st.st_size?load_file(ctx, filename, &size, &errors):NULL;
+		frame_printf(&ctx->screen, "file: %s ", filename);
+		if(errors) frame_printf(&ctx->screen, "%d non-floats skipped ", errors);
+		frame_printf(&ctx->screen, "%d values found.\n", buf?size:0);
+		if(buf && size>0) _graph(ctx, buf, size);
+		frame_show(ctx);
+	}
+}
+/************************************************************************************/
+/* time series: rows of "epoch,value" sorted by time. Only the rows inside the		*/
+/* window are parsed, the first one found by binary search over the text, and the	*/
+/* values are put in buckets aligned to whole seconds, minutes, hours or days		*/
+/************************************************************************************/
+static const double INTERVALS[] = {1e-3, 2e-3, 5e-3, 1e-2, 2e-2, 5e-2, 0.1, 0.2, 0.5,
+	1, 2, 5, 10, 15, 30, 60, 120, 300, 600, 900, 1800, 3600, 7200, 10800, 21600,
+	43200, 86400, 172800, 604800};
+typedef struct								// bucket of a time interval
+{
+	bucket b;
+	double first, last;						// time of the first and last value
+} slot;
+/************************************************************************************/
+/* row_time:	reads the time stamp at the start of a row							*/
+/* parameter: 	p, end - the row and the end of the input							*/
+/* parameter: 	t - the time stamp													*/
+/* returns: 	position after the time stamp, NULL if the row has none				*/
+/************************************************************************************/
+static const char* row_time(const char* p, const char* end, double* t)
+{
+	const char* q;
+	for(;p<end && *p!='\n' && !legal_map[(unsigned char)*p];p++);
+	for(q=p;q<end && legal_map[(unsigned char)*q] && q-p<FBUFMAX;q++);
+	if(q==p || (q<end && legal_map[(unsigned char)*q])) return NULL;	// none, or too long
+	*t = parse_double(p, q-p);
+	return q;
+}
+/************************************************************************************/
+/* next_row:	returns the start of the first row at or after p					*/
+/************************************************************************************/
+static const char* next_row(const char* start, const char* p, const char* end)
+{
+	if(p==start || p[-1]=='\n') return p;
+	p = memchr(p, '\n', end-p);
+	return p?p+1:end;
+}
+/************************************************************************************/
+/* seek_time:	finds the first row with a time stamp of at least t, by binary		*/
+/*				search over the byte offsets of the input. Rows without a time		*/
+/*				stamp, like a header, count as earlier than any time				*/
+/* parameter: 	start, end - the input												*/
+/* parameter: 	t - the time														*/
+/* returns: 	start of the row													*/
+/************************************************************************************/
+static const char* seek_time(const char* start, const char* end, double t)
+{
+	const char *lo=start, *hi=end, *mid, *row;
+	double rt;
+	while(lo<hi)
+	{
+		mid = lo+(hi-lo)/2;
+		row = next_row(start, mid, end);
+		if(row==end || (row_time(row, end, &rt) && rt>=t)) hi = mid;
+		else lo = mid+1;
+	}
+	return next_row(start, lo, end);
+}
+/************************************************************************************/
+/* last_time:	returns the time stamp of the last row that has one					*/
+/************************************************************************************/
+static double last_time(const char* start, const char* end)
+{
+	const char* p = end;
+	double t;
+	while(p>start)
+	{
+		for(p--;p>start && p[-1]!='\n';p--);
+		if(row_time(p, end, &t)) return t;
+	}
+	return 0;
+}
+/************************************************************************************/
+/* graph_load_time:	loads the rows of a file inside the time window, see set_from	*/
+/* parameter: 		ctx - the context, owning the values until the next load		*/
+/* parameter: 		filename - name of file with rows of time stamp and value		*/
+/* parameter: 		times, values - the time stamps and values of the rows			*/
+/* returns: 		# of rows loaded												*/
+/************************************************************************************/
+int graph_load_time(graph_ctx* ctx, char* filename, double** times, float** values)
+{
+	int fd, n=0, cap=0, late=0;
+	struct stat st;
+	char *text=NULL, *map=MAP_FAILED;
+	size_t len=0, tcap=0;
+	ssize_t got;
+	const char *p, *q, *next, *end, *start;
+	double from=ctx->from, to=ctx->to, t, prev=-INFINITY, t0=seconds();
+	fbuf vals = {ctx->values[0], 0, ctx->values_cap[0], -1, 0};
+	printf("file: %s ", filename);
+	setup();
+	fd = open_input(filename, 0);
+	unload(ctx);
+	if(fstat(fd, &st)==0 && S_ISREG(st.st_mode) && st.st_size>0)
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if(map!=MAP_FAILED) {text = map; len = st.st_size;}
+	else for(;;len+=got)					// a pipe is read whole
+	{
+		if(len+65536>tcap && !(text=(char*)realloc(text, tcap=2*tcap+65536)))
+			aerror();
+		if((got=read(fd, text+len, tcap-len))<=0) break;
+	}
+	if(fd!=STDIN_FILENO) close(fd);
+	end = text+len;
+	if(from<0 || to<0)						// relative to the last row
+	{
+		t = last_time(text, end);
+		if(from<0) from += t;
+		if(to<0) to += t;
+	}
+	for(p=start=seek_time(text, end, from);p<end;p=next)
+	{
+		next = memchr(p, '\n', end-p);
+		next = next?next+1:end;
+		if(!(q=row_time(p, end, &t))) continue;
+		if(t>to) break;						// past the window, the rest is later still
+		if(t<prev) late++;
+		prev = t;
+		for(;q<end && *q!='\n' && !legal_map[(unsigned char)*q];q++);
+		for(p=q;q<end && legal_map[(unsigned char)*q] && q-p<FBUFMAX;q++);
+		if(q>p && t>=from && (q==end || !legal_map[(unsigned char)*q]))
+		{
+			if(n>=cap && !(ctx->times=(double*)realloc(ctx->times, (cap=cap?2*cap:4096)*sizeof(double))))
+				aerror();
+			ctx->times[n++] = t;
+			push(&vals, parse_float(p, q-p));
+		}
+	}
+	ctx->stats.bytes += p-start;			// only the window is scanned
+	if(map!=MAP_FAILED) munmap(map, len);
+	else free(text);
+	if(late) printf("%d rows out of order ", late);
+	if(n<=0) f_error(filename, "no rows found in time window");
+	*values = settle(ctx, &vals, 0);
+	*times = ctx->times;
+	ctx->stats.load += seconds()-t0;
+	ctx->stats.values += n;
+	printf("%d values found.\n", n);
+	return n;
+}
+/************************************************************************************/
+/* print_timescale:	draws the x-axis and time scale of the graph					*/
+/* parameter: 		ctx - the context												*/
+/* parameter: 		t0 - time at the start of the first column						*/
+/* parameter: 		interval - time per column										*/
+/************************************************************************************/
+static void print_timescale(graph_ctx* ctx, double t0, double interval)
+{
+	int i;
+	char label[32];
+	time_t t;
+	struct tm tm;							// gmtime_r, contexts may draw on many threads
+	frame* f = &ctx->screen;
+	frame_printf(f, "%4c", ' ');			// padding before x-scale lines
+	frame_reserve(f, ctx->width);
+	for(i=0 ; i<ctx->width; i++)			// print x-scale lines
+		PUT(f, i%10==0?'|':' ');
+	frame_printf(f, "\n%4c", ' ');			// padding before x-scale times
+	for(i=0 ; i<ctx->width; i+=10)
+	{
+		t = floor(t0+i*interval);
+		strftime(label, sizeof(label), interval<60?"%H:%M:%S":interval<3600?"%H:%M":
+					interval<86400?"%d %H:%M":"%m-%d", gmtime_r(&t, &tm));
+		frame_printf(f, "%-10s", label);
+	}
+	t = floor(t0);
+	strftime(label, sizeof(label), "%Y-%m-%d %H:%M:%S", gmtime_r(&t, &tm));
+	frame_printf(f, "\n%4c%s UTC, %g s per column\n", ' ', label, interval);
+}
+/************************************************************************************/
+/* _graph_time:	draws values over time, a column per interval, where the interval	*/
+/*				is the shortest of INTERVALS giving at most ctx->width columns		*/
+/* parameter: 	ctx - the context, the graph is drawn into its frame				*/
+/* parameter: 	times, values, n - the rows											*/
+/************************************************************************************/
+static void _graph_time(graph_ctx* ctx, double* times, float* values, int n)
+{
+	double lo=INFINITY, hi=-INFINITY, interval=0, t0, t=seconds();
+	size_t len=ctx->screen.len;
+	int i, k, cols;
+	float *copy, *low, last=0;
+	slot* col;
+	slot* prev=NULL;
+	if(n<=0) return;						// no rows in the window
+	for(i=0;i<n;i++)
+	{
+		if(times[i]<lo) lo = times[i];
+		if(times[i]>hi) hi = times[i];
+	}
+	for(i=0;i<(int)(sizeof(INTERVALS)/sizeof(INTERVALS[0])) && !interval;i++)
+		if(floor(hi/INTERVALS[i])-floor(lo/INTERVALS[i])<ctx->width)
+			interval = INTERVALS[i];
+	if(!interval)							// whole weeks
+		interval = 604800*ceil((hi-lo)/604800/(ctx->width>1?ctx->width-1:1));
+	t0 = floor(lo/interval)*interval;
+	cols = floor((hi-t0)/interval)+1;
+	if(cols>ctx->width) cols = ctx->width;
+	arena_reset(&ctx->scratch);
+	col = (slot*)arena_alloc(&ctx->scratch, cols*sizeof(slot));
+	copy = (float*)arena_alloc(&ctx->scratch, 2*cols*sizeof(float));
+	memset(col, 0, cols*sizeof(slot));
+	low = copy+cols;
+	ctx->maxval = -FLT_MAX;
+	ctx->minval = FLT_MAX;
+	for(i=0;i<n;i++)						// rows may come in any order
+	{
+		k = floor((times[i]-t0)/interval);
+		if(k>=cols) k = cols-1;
+		if(!col[k].b.count || times[i]<col[k].first) {col[k].first = times[i]; col[k].b.first = values[i];}
+		if(!col[k].b.count || times[i]>=col[k].last) {col[k].last = times[i]; col[k].b.last = values[i];}
+		if(!col[k].b.count || values[i]<col[k].b.min) col[k].b.min = values[i];
+		if(!col[k].b.count || values[i]>col[k].b.max) col[k].b.max = values[i];
+		col[k].b.sum += values[i];
+		col[k].b.count++;
+		if(values[i]>ctx->maxval) ctx->maxval = values[i];
+		if(values[i]<ctx->minval) ctx->minval = values[i];
+	}
+	for(k=0;k<cols;k++)
+	{
+		copy[k] = low[k] = -INFINITY;		// an empty interval draws nothing
+		if(!col[k].b.count) continue;
+		copy[k] = ctx->compression==1?col[k].b.sum/col[k].b.count:col[k].b.first;
+		if(ctx->compression==3)				// span joined to the previous interval
+		{
+			last = prev?prev->b.last:col[k].b.max;
+			copy[k] = last>col[k].b.max?last:col[k].b.max;
+			low[k] = prev&&last<col[k].b.min?last:col[k].b.min;
+		}
+		prev = &col[k];
+	}
+	plot(ctx, &copy, ctx->compression==3?&low:NULL, 1, cols, interval);
+	print_timescale(ctx, t0, interval);
+	ctx->stats.render += seconds()-t;
+	ctx->stats.output += ctx->screen.len-len;
+}
+/************************************************************************************/
+/* graph_time:	draws values over time, see _graph_time								*/
+/************************************************************************************/
+void graph_time(double* times, float* values, int n)
+{
+	printf("graph \u14B7 Copyright (C) 2017 Martin Blom\n");
+	_graph_time(&deflt, times, values, n);
+	frame_flush(&deflt.screen);
+}
+/************************************************************************************/
+/* graph_print_time:	draws values over time to a stream							*/
+/************************************************************************************/
+void graph_print_time(graph_ctx* ctx, double* times, float* values, int n, FILE* out)
+{
+	_graph_time(ctx, times, values, n);
+	fwrite(ctx->screen.data, 1, ctx->screen.len, out);
+	ctx->screen.len = 0;
+}
+/************************************************************************************/
+/* batch: many files are drawn in one process. A pool of workers each loads,		*/
+/* compresses and draws one file at a time into a frame of its own, and the frames	*/
+/* are written out in input order as they become ready								*/
+/************************************************************************************/
+typedef struct								// files of a batch and their frames
+{
+	graph_ctx* ctx;							// settings the files are drawn with
+	char** files;
+	int n;
+	int next;								// next file for a worker to take
+	frame* out;								// frame of each file
+	char* done;								// 1 once the frame of a file is drawn
+	pthread_mutex_t lock;
+	pthread_cond_t ready;					// signalled whenever a frame is done
+} batch_files;
+/************************************************************************************/
+/* batch_add:	appends a name to the files of a batch. Names starting with @ are	*/
+/*				list files of one name per line, other names are expanded as globs	*/
+/************************************************************************************/
+static void batch_add(batch_files* b, int* cap, char* name)
+{
+	FILE* list;
+	char* line=NULL;
+	size_t len=0;
+	ssize_t n;
+	glob_t g;
+	size_t i;
+	if(name[0]=='@')
+	{
+		if(!(list=fopen(name+1, "r"))){f_error(name+1, "cannot open file");exit(-1);}
+		while((n=getline(&line, &len, list))>0)
+		{
+			while(n>0 && (line[n-1]=='\n' || line[n-1]=='\r')) line[--n] = '\0';
+			if(n>0) batch_add(b, cap, line);
+		}
+		free(line);
+		fclose(list);
+		return;
+	}
+	if(strpbrk(name, "*?[") && !glob(name, 0, NULL, &g))
+	{
+		for(i=0;i<g.gl_pathc;i++)
+			batch_add(b, cap, g.gl_pathv[i]);
+		globfree(&g);
+		return;
+	}
+	if(b->n>=*cap)
+	{
+		*cap = *cap?2**cap:64;
+		b->files = (char**)realloc(b->files, *cap*sizeof(char*));
+		if(!b->files) aerror();
+	}
+	if(!(b->files[b->n++]=strdup(name))) aerror();
+}
+/************************************************************************************/
+/* stats_add:	adds the stage timers and counters of from to those of to			*/
+/************************************************************************************/
+static void stats_add(counters* to, const counters* from)
+{
+	to->load += from->load;
+	to->compress += from->compress;
+	to->render += from->render;
+	to->bytes += from->bytes;
+	to->values += from->values;
+	to->skipped += from->skipped;
+	to->output += from->output;
+}
+/************************************************************************************/
+/* batch_worker:	draws files of a batch until none are left, on a context of its	*/
+/*					own with the settings of the batch								*/
+/************************************************************************************/
+static void* batch_worker(void* arg)
+{
+	batch_files* b = (batch_files*)arg;
+	graph_ctx ctx = *b->ctx;
+	int i, size=0, errors=0;
+	float* buf;
+	memset(&ctx.screen, 0, sizeof(frame));		// nothing loaded or drawn is shared
+	memset(&ctx.shown, 0, sizeof(frame));
+	memset(&ctx.delta, 0, sizeof(frame));
+	memset(ctx.values, 0, sizeof(ctx.values));
+	memset(ctx.values_cap, 0, sizeof(ctx.values_cap));
+	memset(&ctx.scratch, 0, sizeof(arena));
+	memset(ctx.spill_map, 0, sizeof(ctx.spill_map));
+	memset(&ctx.index_map, 0, sizeof(pyramid));
+	ctx.times = NULL;
+	memset(&ctx.stats, 0, sizeof(counters));
+	ctx.threads = 1;							// the files are parsed in parallel instead
+	for(;;)
+	{
+		pthread_mutex_lock(&b->lock);
+		i = b->next++;
+		pthread_mutex_unlock(&b->lock);
+		if(i>=b->n) break;
+		frame_printf(&ctx.screen, "file: %s ", b->files[i]);
+		if(access(b->files[i], R_OK))
+			frame_printf(&ctx.screen, "File error in %s: cannot open file\n", b->files[i]);
+		else
+		{
+			buf = load_file(&ctx, b->files[i], &size, &errors);
+			if(errors) frame_printf(&ctx.screen, "%d non-floats skipped ", errors);
+			if(size<=0)
+				frame_printf(&ctx.screen, "File error in %s: no values found in file\n", b->files[i]);
+			else
+			{
+				frame_printf(&ctx.screen, "%d values found.\n", size);
+				_graph(&ctx, buf, size);
+			}
+			unload(&ctx);
+		}
+		pthread_mutex_lock(&b->lock);
+		stats_add(&b->ctx->stats, &ctx.stats);
+		memset(&ctx.stats, 0, sizeof(counters));
+		b->out[i] = ctx.screen;					// the frame is handed to the writer
+		b->done[i] = 1;
+		pthread_cond_broadcast(&b->ready);
+		pthread_mutex_unlock(&b->lock);
+		memset(&ctx.screen, 0, sizeof(frame));
+	}
+	discard(&ctx);
+	return NULL;
+}
+/************************************************************************************/
+/* graph_batch:	draws the graphs of many files to stdout, in the order given		*/
+/* parameter: 	ctx - the context with the settings, its threads set the # of		*/
+/*				files drawn at once, see set_threads								*/
+/* parameter: 	names, n - files, globs such as "*.txt", or @list files				*/
+/* returns: 	# of files drawn													*/
+/************************************************************************************/
+int graph_batch(graph_ctx* ctx, char** names, int n)
+{
+	batch_files b = {ctx, NULL, 0, 0, NULL, NULL, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+	pthread_t tid[256];
+	int i, cap=0, workers=ctx->threads;
+	setup();
+	for(i=0;i<n;i++)
+		batch_add(&b, &cap, names[i]);
+	b.out = (frame*)calloc(b.n+1, sizeof(frame));
+	b.done = (char*)calloc(b.n+1, 1);
+	if(!b.out || !b.done) aerror();
+	if(workers>b.n) workers = b.n;
+	if(workers>256) workers = 256;
+	for(i=0;i<workers;i++)
+		if(pthread_create(&tid[i], NULL, batch_worker, &b)) break;
+	if(i==0) batch_worker(&b);					// no threads, draw them all here
+	for(workers=i, i=0;i<b.n;i++)				// write the frames in input order
+	{
+		pthread_mutex_lock(&b.lock);
+		while(!b.done[i])
+			pthread_cond_wait(&b.ready, &b.lock);
+		pthread_mutex_unlock(&b.lock);
+		frame_flush(&b.out[i]);
+		free(b.out[i].data);
+		free(b.files[i]);
+	}
+	for(i=0;i<workers;i++)
+		pthread_join(tid[i], NULL);
+	free(b.files);
+	free(b.out);
+	free(b.done);
+	return b.n;
+}
+/************************************************************************************/
+/* graph_print_stats:	writes the stage timers and counters of a context as JSON	*/
+/* parameter: 			ctx - the context, counting since it was created			*/
+/* parameter: 			out - the stream											*/
+/************************************************************************************/
+void graph_print_stats(graph_ctx* ctx, FILE* out)
+{
+	counters* c = &ctx->stats;
+	fprintf(out, "{\"load_s\": %.6f, \"compress_s\": %.6f, \"render_s\": %.6f, "
+			"\"bytes_read\": %lld, \"values\": %lld, \"skipped\": %lld, \"output_bytes\": %lld}\n",
+			c->load, c->compress, c->render, c->bytes, c->values, c->skipped, c->output);
+}
+/************************************************************************************/
+/* graph_create:	creates a context with the default settings						*/
+/* returns: 		the context, or NULL if out of memory							*/
+/************************************************************************************/
+graph_ctx* graph_create()
+{
+	graph_ctx init = CTX_DEFAULTS;
+	graph_ctx* ctx = (graph_ctx*)malloc(sizeof(graph_ctx));
+	if(ctx) *ctx = init;
+	return ctx;
+}
+/************************************************************************************/
+/* graph_destroy:	frees a context and the values loaded into it					*/
+/************************************************************************************/
+void graph_destroy(graph_ctx* ctx)
+{
+	if(!ctx) return;
+	discard(ctx);
+	free(ctx);
+}
+/************************************************************************************/
+/* set_style:	sets the character used to represent data points					*/
+/* parameter: 	the character to be used											*/
+/*				if the character is non-standard-ASCII, it is set to '?'			*/
+/************************************************************************************/
+void graph_set_style(graph_ctx* ctx, char style)
+{
+	ctx->styles[0] = style;
+}
+/************************************************************************************/
+/* set_styles:	sets the characters used for the data points of each series			*/
+/* parameter: 	style - one character per series, the rest keep their default		*/
+/************************************************************************************/
+void graph_set_styles(graph_ctx* ctx, char* style)
+{
+	int k;
+	for(k=0;k<SERIESMAX && style[k];k++)
+		ctx->styles[k] = style[k];
+}
+/************************************************************************************/
+/* set_unistyle:	sets the unicode character used to represent data points		*/
+/* parameter: 		style - the code point in hex, e.g. "2588" for a full block		*/
+/*					if the code point is not valid, the program exits				*/
+/************************************************************************************/
+void graph_set_unistyle(graph_ctx* ctx, char* style)
+{
+	long c = strtol(style, NULL, 16);
+	char* u = ctx->unistyle;
+	if(c<=0 || c>0x10FFFF || (c>=0xD800 && c<=0xDFFF)) serror("not a unicode character", c);
+	if(c<0x80) *u++ = c;
+	else if(c<0x800) {*u++ = 0xC0|(c>>6); *u++ = 0x80|(c&0x3F);}
+	else if(c<0x10000) {*u++ = 0xE0|(c>>12); *u++ = 0x80|((c>>6)&0x3F); *u++ = 0x80|(c&0x3F);}
+	else {*u++ = 0xF0|(c>>18); *u++ = 0x80|((c>>12)&0x3F); *u++ = 0x80|((c>>6)&0x3F); *u++ = 0x80|(c&0x3F);}
+	*u = '\0';
+}
+/************************************************************************************/
+/* set_cells:	sets drawing with several points per character						*/
+/* parameter: 	c - 'b' for braille, 2x4 points, 'q' for quadrant blocks, 2x2		*/
+/*				if c is neither 'b' or 'q', the program exits						*/
+/************************************************************************************/
+void graph_set_cells(graph_ctx* ctx, char c)
+{
+	if(c=='b') ctx->cells = 4;
+	else if(c=='q') ctx->cells = 2;
+	else error();
+}
+/************************************************************************************/
+/* set_histogram:	sets drawing the distribution of the values instead of the		*/
+/*					values in order													*/
+/* parameter: 		on - 1 for a histogram, 0 for a graph							*/
+/************************************************************************************/
+void graph_set_histogram(graph_ctx* ctx, int on)
+{
+	ctx->histogram = on;
+}
+/************************************************************************************/
+/* set_width:	sets the width of the graph	(in characters)							*/
+/* parameter: 	s - the width														*/
+/*				if size is wrong, the program exits									*/
+/************************************************************************************/
+void graph_set_width(graph_ctx* ctx, int s)
+{
+	if(s > WMAX) serror("width too large", s);
+	if(s <= 0) serror("width too small", s);
+	ctx->width = s;
+}
+/************************************************************************************/
+/* set_height:	sets the height of the graph	(in characters)						*/
+/* parameter: 	s - the height														*/
+/*				if size is wrong, the program exits									*/
+/************************************************************************************/
+void graph_set_height(graph_ctx* ctx, int s)
+{
+	if(s > HMAX) serror("height too large", s);
+	if(s <= 0) serror("height too small", s);
+	ctx->height = s;
+}
+/************************************************************************************/
+/* set_compression:	sets the compression scheme for the data values					*/
+/* parameter: 	c - 'a' for average, 's' for select, 'm' for min/max spans,			*/
+/*				'q' for p50/p95/p99 bands											*/
+/*				if c is none of these, select is chosen as default					*/
+/************************************************************************************/
+void graph_set_compression(graph_ctx* ctx, char c)
+{
+	if(c=='a') ctx->compression = 1;
+	else if(c=='s') ctx->compression = 2;
+	else if(c=='m') ctx->compression = 3;
+	else if(c=='q') ctx->compression = 4;
+	else cerror();
+}
+/************************************************************************************/
+/* set_columns:	sets the columns of a row drawn as separate series					*/
+/* parameter: 	list - comma separated column numbers counted from 1, e.g. "2,3,4"	*/
+/*				if a column is out of range or there are too many, the program exits*/
+/************************************************************************************/
+void graph_set_columns(graph_ctx* ctx, char* list)
+{
+	int c, k;
+	ctx->ncolumns = 0;
+	for(;*list;list++)
+	{
+		c = atoi(list);
+		if(c<1 || c>COLMAX) serror("column out of range", c);
+		for(k=0;k<ctx->ncolumns;k++)
+			if(ctx->columns[k]==c-1) serror("column given twice", c);
+		if(ctx->ncolumns>=SERIESMAX) serror("too many columns", ctx->ncolumns+1);
+		ctx->columns[ctx->ncolumns++] = c-1;
+		while(isdigit((unsigned char)list[1])) list++;
+		if(list[1]==',') list++;
+	}
+}
+/************************************************************************************/
+/* set_from:	sets the start of the time window									*/
+/* parameter: 	t - seconds since the epoch, or before the last row if negative		*/
+/************************************************************************************/
+void graph_set_from(graph_ctx* ctx, double t)
+{
+	ctx->from = t;
+}
+/************************************************************************************/
+/* set_to:		sets the end of the time window										*/
+/* parameter: 	t - seconds since the epoch, or before the last row if negative		*/
+/************************************************************************************/
+void graph_set_to(graph_ctx* ctx, double t)
+{
+	ctx->to = t;
+}
+/************************************************************************************/
+/* set_window:	sets the # of values kept and graphed when streaming				*/
+/* parameter: 	n - the # of values, rounded up to fill whole columns				*/
+/************************************************************************************/
+void graph_set_window(graph_ctx* ctx, int n)
+{
+	if(n <= 0) serror("window too small", n);
+	ctx->window = n;
+}
+/************************************************************************************/
+/* set_refresh:	sets the interval between redraws when streaming					*/
+/* parameter: 	ms - the interval in milliseconds									*/
+/************************************************************************************/
+void graph_set_refresh(graph_ctx* ctx, int ms)
+{
+	if(ms <= 0) serror("refresh interval too small", ms);
+	ctx->refresh = ms;
+}
+/************************************************************************************/
+/* set_threads:	sets the # of threads used to parse input files						*/
+/* parameter: 	n - the # of threads, 0 for one per online processor				*/
+/************************************************************************************/
+void graph_set_threads(graph_ctx* ctx, int n)
+{
+	if(n < 0) serror("negative thread count", n);
+	if(n == 0) n = sysconf(_SC_NPROCESSORS_ONLN);
+	ctx->threads = n>0?n:1;
+}
+/************************************************************************************/
+/* set_index:	sets whether input files are indexed								*/
+/* parameter: 	on - 1 to read file.graphidx when it is up to date, and write it	*/
+/*				when it is missing or stale											*/
+/************************************************************************************/
+void graph_set_index(graph_ctx* ctx, int on)
+{
+	ctx->index = on;
+}
+/************************************************************************************/
+/* set_format:	sets the format of input files										*/
+/* parameter: 	name - "f32", "f64", "i32" or "i64" for raw little-endian values,	*/
+/*				"text" for values in plain text										*/
+/*				if the format is unknown, the program exits							*/
+/************************************************************************************/
+void graph_set_format(graph_ctx* ctx, char* name)
+{
+	int i;
+	for(i=1;i<(int)(sizeof(FORMATS)/sizeof(FORMATS[0]));i++)
+		if(!strcmp(name, FORMATS[i]))
+		{
+			ctx->format = i;
+			return;
+		}
+	if(strcmp(name, "text")) error();
+	ctx->format = 0;
+}
+/************************************************************************************/
+/* set_stride:	sets the size of the records of binary input						*/
+/* parameter: 	n - bytes per record, 0 for values packed one after another			*/
+/************************************************************************************/
+void graph_set_stride(graph_ctx* ctx, int n)
+{
+	if(n < 0) serror("negative stride", n);
+	ctx->stride = n;
+}
+/************************************************************************************/
+/* set_offset:	sets where in a record of binary input the value is					*/
+/* parameter: 	n - bytes from the start of the record								*/
+/************************************************************************************/
+void graph_set_offset(graph_ctx* ctx, int n)
+{
+	if(n < 0) serror("negative offset", n);
+	ctx->offset = n;
+}
+/************************************************************************************/
+/* functions using the default context, see the graph_* functions above				*/
+/************************************************************************************/
+float* load(char* filename, int* buf_size)	{return graph_load(&deflt, filename, buf_size);}
+void stream(char* filename, int follow)	{graph_stream(&deflt, filename, follow);}
+void watch(char* filename)				{graph_watch(&deflt, filename);}
+int load_columns(char* filename, float** bufs, int* sizes)	{return graph_load_columns(&deflt, filename, bufs, sizes);}
+void set_style(char style)				{graph_set_style(&deflt, style);}
+void set_styles(char* style)			{graph_set_styles(&deflt, style);}
+void set_columns(char* list)			{graph_set_columns(&deflt, list);}
+int load_time(char* filename, double** times, float** values)	{return graph_load_time(&deflt, filename, times, values);}
+void set_from(double t)					{graph_set_from(&deflt, t);}
+void set_to(double t)					{graph_set_to(&deflt, t);}
+void set_unistyle(char* style)			{graph_set_unistyle(&deflt, style);}
+void set_cells(char c)					{graph_set_cells(&deflt, c);}
+void set_width(int s)					{graph_set_width(&deflt, s);}
+void set_height(int s)					{graph_set_height(&deflt, s);}
+void set_compression(char c)			{graph_set_compression(&deflt, c);}
+void set_window(int n)					{graph_set_window(&deflt, n);}
+void set_refresh(int ms)				{graph_set_refresh(&deflt, ms);}
+void set_threads(int n)					{graph_set_threads(&deflt, n);}
+void set_index(int on)					{graph_set_index(&deflt, on);}
+void set_format(char* name)				{graph_set_format(&deflt, name);}
+int batch(char** names, int n)			{return graph_batch(&deflt, names, n);}
+void print_stats()						{graph_print_stats(&deflt, stderr);}
+void set_histogram(int on)				{graph_set_histogram(&deflt, on);}
+void set_stride(int n)					{graph_set_stride(&deflt, n);}
+void set_offset(int n)					{graph_set_offset(&deflt, n);}
\ No newline at end of file
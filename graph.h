@@ -26,40 +26,119 @@ Copyright (C) 2017 	Martin Blom
 #ifndef __GRAPH_H
 #define __GRAPH_H
 #define DEBUG 0					// global debug flag, set to 1 for debug info
-#define MEMMAX 262144			// maximum memory allowed
+#define MEMMAX 262144			// maximum # of values in memory, the rest goes to disk
 #define WMAX 1000				// maximum width of graph
 #define HMAX 500				// maximum height of graph
 #define FBUFMAX 20				// size of single float buffer
+#define SERIESMAX 8				// maximum # of series drawn in one graph
 /************************************************************************************/
 /* library inclusion				 												*/
 /************************************************************************************/
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <stdarg.h>
 #include <float.h>
 #include <ctype.h>
 #include <math.h>
+#include <limits.h>
 #include <locale.h>
 #include <wchar.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <signal.h>
+#include <glob.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 #endif
 /************************************************************************************/
 /* These are the exported functions, i.e. the API for the graph data visualizer		*/
 /* #include this file, and link the corresponding object file to use functionality	*/
 /************************************************************************************/
-float* load(char* filename, int* out_size); // loads file to buffer, returns buffer
+float* load(char* filename, int* out_size); // loads file, returns values owned by the default
+									// context, possibly mmapped: valid until the next load,
+									// never free()d by the caller
 void graph(float *buf, int size);	// draws graph of size values in buf
 void set_style(char style);			// sets the ASCII character used to plot data points
+void set_styles(char* style);		// sets the ASCII character of each series, in order
 void set_unistyle(char* style);		// sets the unicode character used to plot data points 
+void set_cells(char c);				// sets points per character, 'b'=braille 2x4, 'q'=quadrants 2x2
 void set_width(int s);				// sets maximum width of graph
 void set_height(int s);				// sets maximum height of graph
-void set_compression(char c);		// sets compression scheme, 'a'=average, 's'=select
+void set_compression(char c);		// sets compression scheme, 'a'=average, 's'=select, 'm'=min/max, 'q'=quantiles
+void stream(char* filename, int follow);// draws a rolling graph of a stream, "-"=stdin
+void watch(char* filename);			// draws a file again whenever it is rewritten
+void set_window(int n);				// sets # of values graphed when streaming
+void set_refresh(int ms);			// sets redraw interval (ms) when streaming
+void set_threads(int n);			// sets # of threads parsing input, 0=all cores
+void set_index(int on);				// 1 to keep a file.graphidx index of inputs
+void set_columns(char* list);		// sets the columns drawn as series, e.g. "2,3,4"
+int load_columns(char* filename, float** bufs, int* sizes); // loads the columns in one pass,
+									// bufs are owned by the default context as for load
+void graph_columns(float** bufs, int* sizes, int n);	// draws n series on a shared axis
+void set_from(double t);			// sets the start of the time window, <0 before the end
+void set_to(double t);				// sets the end of the time window, <0 before the end
+int load_time(char* filename, double** times, float** values); // loads rows in the window,
+									// owned by the default context as for load
+void graph_time(double* times, float* values, int n);	// draws values over time
+void set_format(char* name);		// sets raw input values, "f32", "f64", "i32", "i64" or "text"
+void set_stride(int n);				// sets bytes per record of raw input, 0=packed
+void set_offset(int n);				// sets the byte of the value in a record of raw input
+int batch(char** names, int n);		// draws many files, globs or @lists in order, on a pool
+void print_stats();					// writes stage timers and counters to stderr, as JSON
+void set_histogram(int on);			// 1 to draw the distribution of the values, 0 the values
 void usage();						// prints how to use the program
 
+/************************************************************************************/
+/* The same functions on a graph context, so that several graphs can be drawn at	*/
+/* once, e.g. on different threads. The functions above use a default context		*/
+/************************************************************************************/
+typedef struct graph_ctx graph_ctx;
+graph_ctx* graph_create();			// creates a context with the default settings
+void graph_destroy(graph_ctx* ctx);	// frees a context and the values loaded into it
+float* graph_load(graph_ctx* ctx, char* filename, int* out_size); // buffer owned by ctx
+int graph_render(graph_ctx* ctx, float* buf, int size, char* out, int cap); // as snprintf
+void graph_print(graph_ctx* ctx, float* buf, int size, FILE* out); // draws to a stream
+int graph_load_columns(graph_ctx* ctx, char* filename, float** bufs, int* sizes);
+void graph_print_columns(graph_ctx* ctx, float** bufs, int* sizes, int n, FILE* out);
+int graph_load_time(graph_ctx* ctx, char* filename, double** times, float** values);
+void graph_print_time(graph_ctx* ctx, double* times, float* values, int n, FILE* out);
+void graph_stream(graph_ctx* ctx, char* filename, int follow);
+void graph_watch(graph_ctx* ctx, char* filename);
+int graph_batch(graph_ctx* ctx, char** names, int n);
+void graph_print_stats(graph_ctx* ctx, FILE* out);
+void graph_set_histogram(graph_ctx* ctx, int on);
+void graph_set_style(graph_ctx* ctx, char style);
+void graph_set_styles(graph_ctx* ctx, char* style);
+void graph_set_columns(graph_ctx* ctx, char* list);
+void graph_set_from(graph_ctx* ctx, double t);
+void graph_set_to(graph_ctx* ctx, double t);
+void graph_set_unistyle(graph_ctx* ctx, char* style);
+void graph_set_cells(graph_ctx* ctx, char c);
+void graph_set_width(graph_ctx* ctx, int s);
+void graph_set_height(graph_ctx* ctx, int s);
+void graph_set_compression(graph_ctx* ctx, char c);
+void graph_set_window(graph_ctx* ctx, int n);
+void graph_set_refresh(graph_ctx* ctx, int ms);
+void graph_set_threads(graph_ctx* ctx, int n);
+void graph_set_index(graph_ctx* ctx, int on);
+void graph_set_format(graph_ctx* ctx, char* name);
+void graph_set_stride(graph_ctx* ctx, int n);
+void graph_set_offset(graph_ctx* ctx, int n);
+
 /************************************************************************************/
 /* error messages, called internally 												*/
 /************************************************************************************/
 void error();						// prints general error message
 void merror();						// prints memory error message
+void aerror();						// prints allocation error message and exits
 void serror(char* msg, int size);	// prints size error message
 void f_error(char* file, char* msg);// prints file error message
 void derror();						// prints data error message
@@ -0,0 +1,301 @@
+/************************************************************************************
+graphbench	- benchmarks for graph, the terminal data visualizer
+Copyright (C) 2017 	Martin Blom
+					e-mail: Martin.Blom@kau.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	graphbench -gN [-csv] file	writes N synthetic values to file
+	graphbench file				times loading and drawing file, prints JSON, and fails
+								if drawing it again allocates memory
+	graphbench -k				fails unless the reduce kernels give bit-identical spans
+	graphbench -a file			fails if drawing file again allocates memory
+*************************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+static long allocs;							// # of heap allocations made by graph.c
+static void* counted_malloc(size_t n)		{allocs++; return malloc(n);}
+static void* counted_calloc(size_t n, size_t m)	{allocs++; return calloc(n, m);}
+static void* counted_realloc(void* p, size_t n)	{allocs++; return realloc(p, n);}
+static char* counted_strdup(const char* s)	{allocs++; return strdup(s);}
+#define malloc(n) counted_malloc(n)
+#define calloc(n, m) counted_calloc(n, m)
+#define realloc(p, n) counted_realloc(p, n)
+#define strdup(s) counted_strdup(s)
+#include "graph.c"							// the internal functions are timed too
+#include <sys/resource.h>
+#define BENCHTIME 0.25						// minimum time (s) spent timing each step
+#define CSVLINE 16							// # of values per line in CSV layout
+#define KERNELCASES 2000					// # of random inputs each kernel reduces
+static double t_start;						// start of the step being timed
+/************************************************************************************/
+/* now:			returns a monotonic time in seconds									*/
+/************************************************************************************/
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+/************************************************************************************/
+/* generate:	writes a synthetic series, a random walk with noise, spikes and		*/
+/*				negative stretches. The same n always gives the same values			*/
+/* parameter: 	filename - the file to write										*/
+/* parameter: 	n - # of values														*/
+/* parameter: 	csv - 1 for comma separated lines, 0 for one value per line			*/
+/************************************************************************************/
+static void generate(char* filename, long n, int csv)
+{
+	FILE* out = fopen(filename, "w");
+	unsigned int seed = 2017;
+	double walk = 0, v;
+	long i;
+	if(!out){f_error(filename, "could not be created");exit(1);}
+	for(i=0;i<n;i++)
+	{
+		seed = seed*1103515245+12345;
+		walk += ((int)((seed>>16)%2001)-1000)/1000.0;	// drifts across zero
+		seed = seed*1103515245+12345;
+		v = walk+((int)((seed>>16)%101)-50)/100.0;		// noise
+		if((seed>>8)%1000==0) v *= 50;					// spikes
+		fprintf(out, "%.5f%c", v, csv&&(i+1)%CSVLINE&&i+1<n?',':'\n');
+	}
+	fclose(out);
+}
+/************************************************************************************/
+/* quiet:		sends stdout to /dev/null, so that only the report is printed		*/
+/* parameter: 	on - 1 to silence stdout, 0 to restore it							*/
+/************************************************************************************/
+static void quiet(int on)
+{
+	static int saved = -1;
+	int null;
+	fflush(stdout);
+	if(on)
+	{
+		saved = dup(STDOUT_FILENO);
+		null = open("/dev/null", O_WRONLY);
+		dup2(null, STDOUT_FILENO);
+		close(null);
+	}
+	else
+	{
+		dup2(saved, STDOUT_FILENO);
+		close(saved);
+	}
+}
+/************************************************************************************/
+/* report:		prints the timing of a step as a JSON member						*/
+/* parameter: 	name - name of the step												*/
+/* parameter: 	runs - # of times the step was run									*/
+/* parameter: 	bytes, values - the data read by one run							*/
+/************************************************************************************/
+static void report(char* name, int runs, double bytes, double values)
+{
+	double t = (now()-t_start)/runs;
+	printf(",\n  \"%s\": {\"runs\": %d, \"sec\": %.6f, \"MB/s\": %.1f, \"values/s\": %.0f}",
+			name, runs, t, bytes/t/1e6, values/t);
+}
+/************************************************************************************/
+/* redraw_allocs:	reloads and redraws a file with each compression scheme and cell*/
+/*					size, as -W does, twice											*/
+/* parameter: 		ctx - the context												*/
+/* parameter: 		filename - the file												*/
+/* return: 			# of heap allocations made by the second round					*/
+/************************************************************************************/
+static long redraw_allocs(graph_ctx* ctx, char* filename)
+{
+	const char schemes[] = "asmq";
+	const char cells[] = "\0bq";
+	float* buf;
+	int size=0, s, c, round, errors;
+	for(round=0;round<2;round++)
+	{
+		allocs = 0;							// the first round may grow the buffers
+		for(s=0;s<(int)strlen(schemes);s++)
+			for(c=0;c<(int)sizeof(cells);c++)
+			{
+				buf = load_file(ctx, filename, &size, &errors);
+				graph_set_compression(ctx, schemes[s]);
+				ctx->cells = cells[c]=='b'?4:cells[c]=='q'?2:0;
+				_graph(ctx, buf, size);
+				ctx->screen.len = 0;
+			}
+	}
+	ctx->cells = 0;
+	return allocs;
+}
+/************************************************************************************/
+/* bench:		times load, each compression scheme and _graph on a file			*/
+/* parameter: 	filename - the file													*/
+/************************************************************************************/
+static void bench(char* filename)
+{
+	const char schemes[] = "asmq";
+	graph_ctx* ctx = graph_create();
+	struct stat st;
+	struct rusage ru;
+	float* buf;
+	float* copy;
+	char name[32];
+	double bytes;							// size of the text
+	int size=0, runs, s, c, threads;
+	int cores = sysconf(_SC_NPROCESSORS_ONLN);
+	if(stat(filename, &st)){f_error(filename, "not found");exit(1);}
+	bytes = st.st_size;
+	quiet(1);
+	t_start = now();
+	buf = graph_load(ctx, filename, &size);
+	quiet(0);
+	printf("{\n  \"file\": \"%s\", \"bytes\": %.0f, \"values\": %d", filename, bytes, size);
+	report("load", 1, bytes, size);
+	copy = (float*)malloc(2*1000*sizeof(float));			// room for -x1000
+	for(s=0;s<(int)strlen(schemes);s++)
+	{
+		graph_set_compression(ctx, schemes[s]);
+		t_start = now();
+		for(runs=0;!runs || now()-t_start<BENCHTIME;runs++)
+			compress_values(ctx, buf, size, copy, copy+ctx->width);
+		sprintf(name, "compress_%c", schemes[s]);
+		report(name, runs, (double)size*sizeof(float), size);
+	}
+	graph_set_width(ctx, 1000);				// columns split across threads
+	graph_set_compression(ctx, 'm');
+	for(threads=1;threads<=cores;threads*=2)
+	{
+		ctx->threads = threads;
+		t_start = now();
+		for(runs=0;!runs || now()-t_start<BENCHTIME;runs++)
+			compress_values(ctx, buf, size, copy, copy+ctx->width);
+		sprintf(name, "compress_m_x1000_t%d", threads);
+		report(name, runs, (double)size*sizeof(float), size);
+	}
+	ctx->threads = 1;
+	graph_set_width(ctx, 68);
+	graph_set_compression(ctx, 's');
+	t_start = now();
+	for(runs=0;!runs || now()-t_start<BENCHTIME;runs++)
+	{
+		_graph(ctx, buf, size);
+		ctx->screen.len = 0;
+	}
+	report("_graph", runs, (double)size*sizeof(float), size);
+	graph_set_width(ctx, 1000);				// a full screen of cells, -x1000 -y500
+	graph_set_height(ctx, 500);
+	for(s=0;s<(int)strlen(schemes);s++)
+		for(c=0;c<2;c++)					// ASCII and UTF-8 points
+		{
+			graph_set_compression(ctx, schemes[s]);
+			ctx->unistyle[0] = '\0';
+			if(c) graph_set_unistyle(ctx, "2588");
+			t_start = now();
+			for(runs=0;!runs || now()-t_start<BENCHTIME;runs++)
+			{
+				_graph(ctx, buf, size);
+				ctx->screen.len = 0;
+			}
+			sprintf(name, "_graph_%c%s_x1000_y500", schemes[s], c?"_utf8":"");
+			report(name, runs, (double)size*sizeof(float), size);
+		}
+	ctx->unistyle[0] = '\0';
+	graph_set_width(ctx, 68);
+	graph_set_height(ctx, 17);
+	quiet(1);
+	redraw_allocs(ctx, filename);
+	quiet(0);
+	printf(",\n  \"steady_allocs\": %ld", allocs);
+	getrusage(RUSAGE_SELF, &ru);
+	printf(",\n  \"peak_rss_kb\": %ld\n}\n", ru.ru_maxrss);
+	free(copy);
+	graph_destroy(ctx);
+	if(allocs) exit(1);						// a redraw should reuse the memory of the last
+}
+/************************************************************************************/
+/* kernels:		reduces random inputs of odd lengths, negatives, zeros of both signs*/
+/*				and infinities with each kernel the CPU supports, and compares the	*/
+/*				spans to the scalar reference bit for bit							*/
+/* return: 		# of mismatches														*/
+/************************************************************************************/
+static int kernels()
+{
+	float p[200];
+	span ref, out;
+	unsigned int seed = 2017;
+	int c, i, n, bad=0, checked=0;
+	__builtin_cpu_init();
+	for(c=0;c<KERNELCASES;c++)
+	{
+		seed = seed*1103515245+12345;
+		n = (seed>>16)%200;
+		for(i=0;i<n;i++)
+		{
+			seed = seed*1103515245+12345;
+			switch((seed>>8)%16)
+			{
+				case 0: p[i] = -0.0f; break;
+				case 1: p[i] = 0.0f; break;
+				case 2: p[i] = (seed>>12)%64?-1e30f:-INFINITY; break;
+				default: p[i] = ((int)((seed>>12)%20001)-10000)/7.0f;
+			}
+			if(c%3==0 && p[i]<0) p[i] = -p[i];		// the smallest may be a zero
+			if(c%3==1 && p[i]>0) p[i] = -p[i];		// so may the largest
+		}
+		reduce_scalar(p+c%4, n-c%4>0?n-c%4:0, &ref);	// unaligned starts too
+#if defined(__x86_64__) || defined(__i386__)
+		if(__builtin_cpu_supports("sse2"))
+		{
+			reduce_sse2(p+c%4, n-c%4>0?n-c%4:0, &out);
+			bad += memcmp(&ref, &out, sizeof(span))!=0;
+			checked++;
+		}
+		if(__builtin_cpu_supports("avx2"))
+		{
+			reduce_avx2(p+c%4, n-c%4>0?n-c%4:0, &out);
+			bad += memcmp(&ref, &out, sizeof(span))!=0;
+			checked++;
+		}
+#endif
+	}
+	printf("{\"kernel_cases\": %d, \"mismatches\": %d}\n", checked, bad);
+	return bad;
+}
+/************************************************************************************/
+/* main																				*/
+/************************************************************************************/
+int main(int argc, char** argv)
+{
+	graph_ctx* ctx;
+	if(argc==2 && !strcmp(argv[1], "-k"))
+		return kernels()?1:0;
+	if(argc==3 && !strcmp(argv[1], "-a"))
+	{
+		ctx = graph_create();
+		quiet(1);
+		redraw_allocs(ctx, argv[2]);
+		quiet(0);
+		graph_destroy(ctx);
+		printf("{\"steady_allocs\": %ld}\n", allocs);
+		return allocs?1:0;						// a redraw should reuse the memory of the last
+	}
+	if(argc>2 && argv[1][0]=='-' && argv[1][1]=='g')
+		generate(argv[argc-1], atol(&(argv[1][2])), !strcmp(argv[2], "-csv"));
+	else if(argc==2)
+		bench(argv[1]);
+	else
+	{
+		printf("usage: graphbench -gN [-csv] file | graphbench file | graphbench -k | graphbench -a file\n");
+		return -1;
+	}
+	return 0;
+}
@@ -20,6 +20,13 @@ Copyright (C) 2017 	Martin Blom
  	date:		September 20, 2017												   	
 *************************************************************************************/
 #include "graph.h"
+static int follow = 0;						// 1 if the input should be followed
+static int columns = 0;						// 1 if columns are drawn as series
+static int timed = 0;						// 1 if rows are graphed over time
+static int watching = 0;					// 1 if the file is graphed whenever rewritten
+static int binary = 0;						// 1 if the input is raw values
+static int histo = 0;						// 1 if a histogram is drawn
+static int threaded = 0;					// 1 if the # of threads is given
 /************************************************************************************/
 /* set_size:	sets the size of the graph											*/
 /* parameter: 	the argument from the command line used for size setting			*/
@@ -59,19 +66,29 @@ static void print_welcome()
 /* process_args:	processes the command line arguments							*/
 /* parameter: 		argc and argv as provided to main								*/
 /*					-s sets the style, -x sets width, -y sets height, -h shows help */
-/*					if the argument does not start with a hyphen, the program exits */
+/*					-f follows the input, -w sets window size, -r sets refresh		*/
+/*					-W watches the file for changes									*/
+/*					-t sets the # of threads parsing the input, -i indexes it		*/
+/*					-k selects columns drawn as series, styled by the -s characters	*/
+/*					-u draws several points per character							*/
+/*					-T, --from=T and --to=T graph rows of epoch,value over time		*/
+/*					--format=F, --stride=N and --offset=M read raw values			*/
+/*					-H draws a histogram of the values								*/
+/*					--stats writes stage timers and counters to stderr on exit		*/
+/*					the options end at the first argument not starting with a		*/
+/*					hyphen, the rest are files										*/
 /*					if the argument is unknown, the program exits					*/
+/* returns: 		index of the first file in argv									*/
 /************************************************************************************/
-static void process_args(int argc, char** argv)
+static int process_args(int argc, char** argv)
 {
 	int i;
-	for(i=1;i<argc-1;i++)
+	for(i=1;i<argc-1 && argv[i][0]=='-' && argv[i][1];i++)
 	{
-		if(argv[i][0]!='-') error();
 		switch(argv[i][1])
 		{
 			case 's': 	if(!isdigit(argv[i][2]))
-							set_style(argv[i][2]); 	
+							set_styles(&(argv[i][2]));
 						else
 							set_unistyle(&(argv[i][2]));
 													break;
@@ -79,10 +96,44 @@ static void process_args(int argc, char** argv)
 			case 'y': set_size(argv[i]); 			break;
 			case 'l': print_welcome();				break;
 			case 'c': set_compression(argv[i][2]);	break;
+			case 'f': follow = 1;					break;
+			case 'w': set_window(atoi(&(argv[i][2])));	break;
+			case 'r': set_refresh(atoi(&(argv[i][2])));	break;
+			case 't': set_threads(atoi(&(argv[i][2]))); threaded = 1;	break;
+			case 'i': set_index(1);					break;
+			case 'u': set_cells(argv[i][2]);		break;
+			case 'T': timed = 1;					break;
+			case 'W': watching = 1;					break;
+			case 'H': set_histogram(1); histo = 1;	break;
+			case '-': if(!strncmp(argv[i], "--from=", 7))
+						{
+							set_from(atof(&(argv[i][7])));
+							timed = 1;
+						}
+						else if(!strncmp(argv[i], "--to=", 5))
+						{
+							set_to(atof(&(argv[i][5])));
+							timed = 1;
+						}
+						else if(!strncmp(argv[i], "--format=", 9))
+						{
+							set_format(&(argv[i][9]));
+							binary = strcmp(&(argv[i][9]), "text")!=0;
+						}
+						else if(!strcmp(argv[i], "--stats"))
+							atexit(print_stats);
+						else if(!strncmp(argv[i], "--stride=", 9))
+							set_stride(atoi(&(argv[i][9])));
+						else if(!strncmp(argv[i], "--offset=", 9))
+							set_offset(atoi(&(argv[i][9])));
+						else error();
+													break;
+			case 'k': set_columns(&(argv[i][2])); columns = 1;	break;
 			case 'h': usage(); exit(0);				break;
 			default: error();						break;
 		}
 	}
+	return i;
 }
 /************************************************************************************/
 /* main																				*/
@@ -90,10 +141,44 @@ static void process_args(int argc, char** argv)
 int main(int argc, char** argv)
 {
 	float* buffer=NULL;
-	int size=0;
-	if(argc<2||argc>5) error();
+	float* bufs[SERIESMAX];					// one buffer per column
+	int size=0, sizes[SERIESMAX];
+	double* times;
+	int first;
+	if(argc<2) error();
 	printf("graph \u14B7 Copyright (C) 2017 Martin Blom\n");
-	process_args(argc, argv);
+	first = process_args(argc, argv);
+	if(argc-first>1 || argv[first][0]=='@' || strpbrk(argv[first], "*?["))
+	{
+		if(watching || timed || columns || follow) error();	// one file at a time
+		if(!threaded) set_threads(0);						// a worker per core by default
+		batch(&argv[first], argc-first);
+		return 0;
+	}
+	if(binary && (timed || columns || follow)) error();	// raw values are loaded whole
+	if(histo && (timed || follow)) error();				// so are the values of a histogram
+	if(columns && (timed || follow || watching)) error();	// and columns
+	if(watching)
+	{
+		watch(argv[argc-1]);
+		return 0;
+	}
+	if(timed)
+	{
+		size = load_time(argv[argc-1], &times, &buffer);
+		graph_time(times, buffer, size);
+		return 0;
+	}
+	if(columns)									// columns are read whole, even from stdin
+	{
+		graph_columns(bufs, sizes, load_columns(argv[argc-1], bufs, sizes));
+		return 0;
+	}
+	if(follow||(!binary && !histo && !strcmp(argv[argc-1], "-") && isatty(STDOUT_FILENO)))
+	{
+		stream(argv[argc-1], follow);
+		return 0;
+	}
 	buffer = load(argv[argc-1], &size);
 	if(DEBUG)printf("size = %d\n", size);
 	if(!buffer)printf("Memory error, buffer==NULL\n");